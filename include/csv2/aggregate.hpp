@@ -0,0 +1,239 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace csv2 {
+
+enum class aggregate_op { count, sum, min, max, mean };
+
+// One output column of group_by(): `op` over the numbers in column `col`.
+// count counts the rows of the group and ignores `col`; the others skip
+// cells that are empty or not a number.
+struct aggregate {
+  aggregate_op op;
+  size_t col{0};
+};
+
+struct group_by_options {
+  size_t threads{0};        // 0: one per core
+  size_t chunk_rows{65536}; // rows a thread takes at a time
+};
+
+// A group: the cells of the key columns (without surrounding whitespace and
+// quotes, pointing into the reader's buffer) and one value per aggregate,
+// NaN for a min, max or mean without any number
+struct group {
+  std::vector<std::string_view> keys;
+  std::vector<double> values;
+  uint64_t rows{0};
+};
+
+namespace detail {
+
+// Open-addressing table from the raw bytes of the key cells to flat arrays
+// of keys and accumulators. Slots hold the group number and the top bits of
+// its hash, so probing reads one array and compares key bytes only on a
+// matching hash.
+class group_table {
+  size_t nkeys_, naggs_;
+  std::vector<uint64_t> slots_; // group + 1 in the low 32 bits (0: empty), hash above
+  uint64_t mask_{0};
+
+public:
+  std::vector<std::string_view> keys;  // group * nkeys_ + key
+  std::vector<double> values;          // group * naggs_ + aggregate
+  std::vector<uint64_t> counts;        // numbers (count: rows) behind each value
+  std::vector<uint64_t> hashes;        // per group
+  std::vector<size_t> first_rows;      // per group
+  std::vector<uint64_t> rows;          // per group
+
+  group_table(size_t nkeys, size_t naggs)
+      : nkeys_(nkeys), naggs_(naggs), slots_(1024), mask_(1023) {}
+
+  size_t size() const { return hashes.size(); }
+
+  // Group of the key cells key[0, nkeys_), added with `first_row` if new
+  size_t find_or_insert(uint64_t hash, const std::string_view *key, size_t first_row,
+                        const std::vector<aggregate> &aggregates) {
+    const uint64_t tag = hash >> 32;
+    for (uint64_t i = hash & mask_;; i = (i + 1) & mask_) {
+      const auto slot = slots_[i];
+      if (slot == 0) {
+        const auto group = size();
+        slots_[i] = (tag << 32) | (group + 1);
+        hashes.push_back(hash);
+        first_rows.push_back(first_row);
+        rows.push_back(0);
+        keys.insert(keys.end(), key, key + nkeys_);
+        for (const auto &a : aggregates)
+          values.push_back(a.op == aggregate_op::min   ? std::numeric_limits<double>::infinity()
+                           : a.op == aggregate_op::max ? -std::numeric_limits<double>::infinity()
+                                                       : 0.0);
+        counts.resize(counts.size() + naggs_);
+        if (size() * 2 > slots_.size())
+          grow_();
+        return group;
+      }
+      const size_t group = (slot & 0xFFFFFFFF) - 1;
+      if (slot >> 32 == tag && std::equal(key, key + nkeys_, keys.begin() + group * nkeys_))
+        return group;
+    }
+  }
+
+private:
+  void grow_() {
+    slots_.assign(slots_.size() * 2, 0);
+    mask_ = slots_.size() - 1;
+    for (size_t group = 0; group < size(); ++group) {
+      auto i = hashes[group] & mask_;
+      while (slots_[i] != 0)
+        i = (i + 1) & mask_;
+      slots_[i] = (hashes[group] >> 32 << 32) | (group + 1);
+    }
+  }
+};
+
+inline void accumulate(aggregate_op op, double value, double &result) {
+  switch (op) {
+  case aggregate_op::count:
+    break;
+  case aggregate_op::sum:
+  case aggregate_op::mean:
+    result += value;
+    break;
+  case aggregate_op::min:
+    result = std::min(result, value);
+    break;
+  case aggregate_op::max:
+    result = std::max(result, value);
+    break;
+  }
+}
+
+} // namespace detail
+
+// Group the data rows by the cells of `key_cols` and compute `aggregates`
+// per group, in the order the groups first appear in the file. Only the key
+// and aggregated columns of a row are looked at, and keys are compared as
+// bytes without building strings. Threads take chunks of rows, aggregate
+// them in tables of their own and the tables are merged at the end.
+template <class ReaderT>
+std::vector<group> group_by(const ReaderT &reader, const std::vector<size_t> &key_cols,
+                            const std::vector<aggregate> &aggregates,
+                            group_by_options options = {}) {
+  const size_t nkeys = key_cols.size(), naggs = aggregates.size();
+  size_t width = 0;
+  for (const auto col : key_cols)
+    width = std::max(width, col + 1);
+  for (const auto &a : aggregates)
+    if (a.op != aggregate_op::count)
+      width = std::max(width, a.col + 1);
+
+  const size_t rows = reader.size();
+  const size_t chunk_rows = std::max<size_t>(options.chunk_rows, 1);
+  const size_t chunks = (rows + chunk_rows - 1) / chunk_rows;
+  const size_t threads = std::max<size_t>(
+      1, std::min<size_t>(options.threads ? options.threads
+                                          : std::max(1u, std::thread::hardware_concurrency()),
+                          chunks));
+  std::vector<detail::group_table> tables(threads, detail::group_table(nkeys, naggs));
+  std::atomic<size_t> next_chunk{0};
+
+  const auto run = [&](detail::group_table &table) {
+    const auto quote = reader.get_quote_ch();
+    std::vector<std::string_view> cells(width), key(nkeys);
+    for (size_t chunk; (chunk = next_chunk.fetch_add(1)) < chunks;) {
+      const size_t first = chunk * chunk_rows, last = std::min(first + chunk_rows, rows);
+      auto it = reader(first);
+      for (size_t irow = first; irow < last; ++irow, ++it) {
+        const auto row = *it;
+        auto cell = row.begin();
+        for (size_t col = 0; col < width; ++col, ++cell)
+          cells[col] = (*cell).raw_view();
+
+        uint64_t hash = 0;
+        for (size_t k = 0; k < nkeys; ++k) {
+          key[k] = detail::strip_cell(cells[key_cols[k]], quote);
+          hash = detail::mix64(hash ^ detail::hash_bytes(key[k]));
+        }
+        const auto group = table.find_or_insert(hash, key.data(), irow, aggregates);
+        ++table.rows[group];
+        for (size_t a = 0; a < naggs; ++a) {
+          const auto op = aggregates[a].op;
+          double value;
+          if (op == aggregate_op::count)
+            ++table.counts[group * naggs + a];
+          else if (detail::parse_number(cells[aggregates[a].col], value, quote) && value == value) {
+            detail::accumulate(op, value, table.values[group * naggs + a]);
+            ++table.counts[group * naggs + a];
+          }
+        }
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t)
+    workers.emplace_back(run, std::ref(tables[t]));
+  run(tables[0]);
+  for (auto &worker : workers)
+    worker.join();
+
+  // merge the partial tables into the first one
+  auto &merged = tables[0];
+  for (size_t t = 1; t < threads; ++t) {
+    const auto &table = tables[t];
+    for (size_t g = 0; g < table.size(); ++g) {
+      const auto group = merged.find_or_insert(table.hashes[g], table.keys.data() + g * nkeys,
+                                               table.first_rows[g], aggregates);
+      merged.first_rows[group] = std::min(merged.first_rows[group], table.first_rows[g]);
+      merged.rows[group] += table.rows[g];
+      for (size_t a = 0; a < naggs; ++a) {
+        detail::accumulate(aggregates[a].op, table.values[g * naggs + a],
+                           merged.values[group * naggs + a]);
+        merged.counts[group * naggs + a] += table.counts[g * naggs + a];
+      }
+    }
+  }
+
+  std::vector<size_t> order(merged.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return merged.first_rows[a] < merged.first_rows[b]; });
+  std::vector<group> result(merged.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const auto g = order[i];
+    auto &out = result[i];
+    out.keys.assign(merged.keys.begin() + g * nkeys, merged.keys.begin() + (g + 1) * nkeys);
+    out.rows = merged.rows[g];
+    for (size_t a = 0; a < naggs; ++a) {
+      const auto value = merged.values[g * naggs + a];
+      const auto count = merged.counts[g * naggs + a];
+      switch (aggregates[a].op) {
+      case aggregate_op::count:
+        out.values.push_back(double(count));
+        break;
+      case aggregate_op::sum:
+        out.values.push_back(value);
+        break;
+      case aggregate_op::mean:
+        out.values.push_back(count ? value / count : std::numeric_limits<double>::quiet_NaN());
+        break;
+      case aggregate_op::min:
+      case aggregate_op::max:
+        out.values.push_back(count ? value : std::numeric_limits<double>::quiet_NaN());
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace csv2
@@ -0,0 +1,520 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <csv2/reader.hpp>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define CSV2_HAS_IO_URING 1
+#endif
+
+namespace csv2 {
+
+struct block_reader_options {
+  size_t block_size{4 * 1024 * 1024}; // bytes per read, rounded up to 4 KiB
+  size_t queue_depth{4};              // reads kept in flight
+  size_t carry_capacity{64 * 1024};   // room in front of each block for a row split by the previous one
+  bool direct{false};                 // open with O_DIRECT to bypass the page cache
+  bool io_uring{true};                // use io_uring when the kernel allows it, pread otherwise
+};
+
+namespace detail {
+
+#ifdef CSV2_HAS_IO_URING
+// Minimal io_uring submission/completion ring driven through the raw
+// syscalls, so there is no dependency on liburing.
+class Uring {
+  int ring_fd_{-1};
+  unsigned entries_{0};
+  unsigned *sq_head_{nullptr}, *sq_tail_{nullptr}, *sq_mask_{nullptr}, *sq_array_{nullptr};
+  unsigned *cq_head_{nullptr}, *cq_tail_{nullptr}, *cq_mask_{nullptr};
+  io_uring_sqe *sqes_{nullptr};
+  io_uring_cqe *cqes_{nullptr};
+  void *sq_ptr_{MAP_FAILED}, *cq_ptr_{MAP_FAILED};
+  size_t sq_len_{0}, cq_len_{0}, sqes_len_{0};
+
+public:
+  Uring() = default;
+  Uring(const Uring &) = delete;
+  Uring &operator=(const Uring &) = delete;
+  ~Uring() { close(); }
+
+  bool open(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0)
+      return false;
+
+    entries_ = params.sq_entries;
+    sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+
+    sq_ptr_ = ::mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                     IORING_OFF_SQ_RING);
+    cq_ptr_ = single_mmap ? sq_ptr_
+                          : ::mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = ::mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQES);
+    if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED) {
+      if (sqes != MAP_FAILED)
+        ::munmap(sqes, sqes_len_);
+      close();
+      return false;
+    }
+
+    auto sq = static_cast<char *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+    return true;
+  }
+
+  void close() {
+    if (sqes_)
+      ::munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+      ::munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ != MAP_FAILED)
+      ::munmap(sq_ptr_, sq_len_);
+    if (ring_fd_ >= 0)
+      ::close(ring_fd_);
+    sqes_ = nullptr;
+    sq_ptr_ = cq_ptr_ = MAP_FAILED;
+    ring_fd_ = -1;
+  }
+
+  // Queues a read and submits it; false if it is not in the ring, and then
+  // no completion will ever come for it
+  bool submit_read(int fd, char *buffer, unsigned length, uint64_t offset, uint64_t user_data) {
+    const unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= entries_)
+      return false;
+    const unsigned index = tail & *sq_mask_;
+    auto sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (true) {
+      const auto submitted = ::syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0);
+      if (submitted == 1 || __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) != tail)
+        return true;
+      if (submitted < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      // the kernel only takes entries inside io_uring_enter, so this one
+      // can be taken back rather than left for a later submit to flush
+      // into a buffer that has been reused by then
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+  }
+
+  // Blocks until a completion is available
+  bool wait(uint64_t &user_data, int &result) {
+    while (true) {
+      const unsigned head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const auto &cqe = cqes_[head & *cq_mask_];
+        user_data = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+      if (::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR)
+        return false;
+    }
+  }
+};
+#endif
+
+// Ring of aligned block buffers filled by io_uring, or by pread when
+// io_uring is unavailable. Every slot has `carry` bytes in front of its
+// read area so a row split across two blocks can be joined without a copy
+// of the whole block.
+class BlockRing {
+  static constexpr size_t alignment = 4096;
+
+  struct Slot {
+    char *memory{nullptr}; // aligned allocation: [carry][block][alignment]
+    uint64_t offset{0};    // file offset of the block in flight
+    size_t expected{0};    // bytes that should come back for this block
+    long result{-1};       // bytes read once complete, -errno on failure
+    bool pending{false};   // submitted but not yet completed
+    bool queued{false};    // pending in the io_uring, a completion will come
+  };
+
+  int fd_{-1};
+  size_t file_size_{0};
+  size_t block_size_{0};
+  size_t carry_{0};
+  uint64_t next_offset_{0};
+  std::vector<Slot> slots_;
+#ifdef CSV2_HAS_IO_URING
+  Uring uring_;
+#endif
+  bool use_uring_{false};
+
+public:
+  BlockRing() = default;
+  BlockRing(const BlockRing &) = delete;
+  BlockRing &operator=(const BlockRing &) = delete;
+  ~BlockRing() { close(); }
+
+  bool open(const std::string &filename, const block_reader_options &options = block_reader_options{}) {
+    close();
+    fd_ = -1;
+#ifdef O_DIRECT
+    if (options.direct)
+      fd_ = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+#endif
+    // some filesystems (tmpfs) reject O_DIRECT, read through the cache there
+    if (fd_ < 0)
+      fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+      return false;
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      close();
+      return false;
+    }
+    file_size_ = static_cast<size_t>(st.st_size);
+    block_size_ = round_up_(std::max<size_t>(options.block_size, 1));
+    carry_ = round_up_(options.carry_capacity);
+    // the block holding the current rows stays out of the ring, so at least two
+    slots_.resize(std::max<size_t>(options.queue_depth, 2));
+    for (auto &slot : slots_) {
+      slot.memory = static_cast<char *>(std::aligned_alloc(alignment, carry_ + block_size_ + alignment));
+      if (!slot.memory) {
+        close();
+        return false;
+      }
+    }
+#ifdef CSV2_HAS_IO_URING
+    use_uring_ = options.io_uring && uring_.open(static_cast<unsigned>(slots_.size()));
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!use_uring_)
+      ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    next_offset_ = 0;
+    for (size_t i = 0; i < slots_.size(); ++i)
+      submit_(i);
+    return true;
+  }
+
+  void close() {
+    // let in-flight reads land before their buffers are freed
+    for (size_t i = 0; i < slots_.size(); ++i)
+      if (slots_[i].queued)
+        wait(i);
+#ifdef CSV2_HAS_IO_URING
+    uring_.close();
+#endif
+    for (auto &slot : slots_)
+      std::free(slot.memory);
+    slots_.clear();
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+    use_uring_ = false;
+  }
+
+  auto slots() const { return slots_.size(); }
+  auto carry() const { return carry_; }
+  auto file_size() const { return file_size_; }
+  bool uses_io_uring() const { return use_uring_; }
+
+  // Start of the read area of slot i; the carry area is the `carry()` bytes before it
+  char *data(size_t i) const { return slots_[i].memory + carry_; }
+  // Slot i holds no block, the file has been read to the end
+  bool eof(size_t i) const { return slots_[i].expected == 0; }
+
+  // Waits for slot i and returns the number of bytes in it, -errno on failure
+  long wait(size_t i) {
+    auto &slot = slots_[i];
+    if (!slot.pending)
+      return slot.result;
+#ifdef CSV2_HAS_IO_URING
+    while (slot.queued) {
+      uint64_t user_data;
+      int result;
+      if (!uring_.wait(user_data, result)) {
+        slot.queued = false;
+        break;
+      }
+      slots_[user_data].result = result;
+      slots_[user_data].pending = slots_[user_data].queued = false;
+    }
+#endif
+    // pread path, or a kernel without IORING_OP_READ
+    if (slot.pending || slot.result == -EINVAL) {
+      slot.result = 0;
+      slot.pending = false;
+    }
+    // finish short reads (and reads the ring could not serve) synchronously
+    while (slot.result >= 0 && static_cast<size_t>(slot.result) < slot.expected) {
+      // O_DIRECT needs an aligned length as well, the slot has room for it
+      const auto n = ::pread(fd_, data(i) + slot.result, round_up_(slot.expected - slot.result),
+                             static_cast<off_t>(slot.offset + slot.result));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        slot.result = n < 0 ? -errno : slot.result;
+        break;
+      }
+      slot.result = std::min<long>(slot.result + n, static_cast<long>(slot.expected));
+    }
+    return slot.result;
+  }
+
+  // Hands slot i back for the next unread block of the file
+  void recycle(size_t i) { submit_(i); }
+
+private:
+  static size_t round_up_(size_t n) { return (n + alignment - 1) / alignment * alignment; }
+
+  void submit_(size_t i) {
+    auto &slot = slots_[i];
+    slot.offset = next_offset_;
+    slot.expected = next_offset_ < file_size_ ? std::min(block_size_, file_size_ - next_offset_) : 0;
+    slot.result = 0;
+    slot.pending = slot.expected > 0;
+    next_offset_ += slot.expected;
+#ifdef CSV2_HAS_IO_URING
+    // O_DIRECT wants the length aligned too, the kernel stops at end of file anyway
+    slot.queued = slot.pending && use_uring_ &&
+                  uring_.submit_read(fd_, data(i), static_cast<unsigned>(block_size_), slot.offset, i);
+#endif
+    // otherwise read synchronously in wait()
+  }
+};
+
+} // namespace detail
+
+// Parses rows out of the chunks of a Source, a ring of buffers consumed in
+// order: `wait(i)` blocks until slot i is filled and returns its size,
+// `eof(i)` tells whether it marks the end of the input, `recycle(i)` hands it
+// back for refilling, and `data(i)` has `carry()` writable bytes in front and
+// one behind. Rows and cells are the same types as Reader's; a Row stays valid
+// until the iterator moves past the chunk it came from. Single pass only.
+template <class Source, class delimiter = delimiter<','>,
+          class quote_character = quote_character<'"'>,
+          class first_row_is_header = first_row_is_header<true>,
+          class trim_policy = trim_policy::trim_whitespace>
+class BasicBlockReader {
+  using ReaderT = Reader<delimiter, quote_character, first_row_is_header, trim_policy>;
+
+  Source ring_;
+  ReaderT header_;                  // parses the header rows out of header_bytes_
+  std::string header_bytes_;        // header rows copied out of the first block
+  std::vector<char> spill_;         // rows longer than the carry area are joined here
+  size_t slot_{0};                  // ring slot backing the current view
+  bool holding_{false};             // slot_ is in use by the current view
+  const char *view_{nullptr};       // complete rows of the current block
+  size_t view_size_{0};
+  const char *tail_{nullptr};       // unfinished row at the end of the current block
+  size_t tail_size_{0};
+  size_t line_no_{0};
+  bool eof_{true};
+  int error_{0};                    // errno of a failed read, iteration stops there
+  std::optional<typename ReaderT::RowIterator> cursor_;
+
+public:
+  using Row = typename ReaderT::Row;
+  using Cell = typename ReaderT::Cell;
+
+  BasicBlockReader() = default;
+  BasicBlockReader(const BasicBlockReader &) = delete;
+  BasicBlockReader &operator=(const BasicBlockReader &) = delete;
+
+  // Extra arguments are passed on to Source::open
+  template <typename StringType, typename... Options>
+  bool open(StringType &&filename, Options &&...options) {
+    cursor_.reset();
+    spill_.clear();
+    header_bytes_.clear();
+    line_no_ = 0;
+    tail_size_ = 0;
+    eof_ = true;
+    error_ = 0;
+    if (!ring_.open(std::string(filename), std::forward<Options>(options)...))
+      return false;
+    slot_ = 0;
+    holding_ = false;
+    eof_ = false;
+    if (!next_view_())
+      return true;
+
+    // header rows come from the first block; copy them out so they outlive it
+    header_.buffer_ = view_;
+    header_.buffer_size_ = view_size_;
+    header_.init_();
+    const auto header_size =
+        header_.headers_.empty() ? 0 : std::min(header_.header_indices_().second + 1, view_size_);
+    header_bytes_.assign(view_, header_size);
+    header_.buffer_ = header_bytes_.data();
+    header_.buffer_size_ = header_bytes_.size();
+    header_.init_();
+
+    view_ += header_size;
+    view_size_ -= header_size;
+    if (view_size_ == 0 && !next_view_())
+      return true;
+    cursor_.emplace(view_, view_size_, 0, line_no_, header_.col_cnt_);
+    return true;
+  }
+
+  const auto &header() const { return header_.header(); }
+  auto cols() const { return header_.cols(); }
+  // 0 unless iteration stopped early on a read or decode error
+  auto error() const { return error_; }
+  const Source &source() const { return ring_; }
+  bool uses_io_uring() const { return ring_.uses_io_uring(); }
+
+  class RowIterator {
+    friend class BasicBlockReader;
+    BasicBlockReader *reader_{nullptr};
+    explicit RowIterator(BasicBlockReader *reader) : reader_(reader) {}
+
+  public:
+    using value_type = Row;
+    using reference = Row;
+
+    RowIterator() = default;
+    RowIterator &operator++() {
+      if (!reader_->next_row_())
+        reader_ = nullptr;
+      return *this;
+    }
+    Row operator*() { return **reader_->cursor_; }
+    auto line_no() const { return reader_->cursor_->line_no(); }
+    bool operator==(const RowIterator &rhs) const { return reader_ == rhs.reader_; }
+    bool operator!=(const RowIterator &rhs) const { return !(*this == rhs); }
+  };
+  using iterator = RowIterator;
+
+  RowIterator begin() { return RowIterator(cursor_ ? this : nullptr); }
+  RowIterator end() { return RowIterator(); }
+
+private:
+  bool next_row_() {
+    auto &cursor = *cursor_;
+    ++cursor;
+    ++line_no_;
+    if (cursor != view_end_())
+      return true;
+    if (!next_view_()) {
+      cursor_.reset();
+      return false;
+    }
+    cursor_.emplace(view_, view_size_, 0, line_no_, header_.col_cnt_);
+    return true;
+  }
+
+  typename ReaderT::RowIterator view_end_() const {
+    return typename ReaderT::RowIterator(view_, view_size_, view_size_, 0, 0);
+  }
+
+  // Moves to the next block holding at least one complete row. Every view
+  // ends with '\n' so the row iterator stops exactly at its end.
+  bool next_view_() {
+    while (!eof_) {
+      const auto next = holding_ ? (slot_ + 1) % ring_.slots() : slot_;
+      const auto read = ring_.wait(next);
+      if (read < 0) {
+        error_ = static_cast<int>(-read);
+        eof_ = true;
+        return false;
+      }
+
+      // join the unfinished row of the previous view in front of this chunk
+      auto block = ring_.data(next);
+      const char *start = block - tail_size_;
+      size_t size = tail_size_ + static_cast<size_t>(read);
+      if (tail_size_ > ring_.carry()) {
+        std::vector<char> joined;
+        joined.reserve(size + 1);
+        joined.assign(tail_, tail_ + tail_size_);
+        joined.insert(joined.end(), block, block + read);
+        spill_.swap(joined);
+        start = spill_.data();
+      } else if (tail_size_ > 0) {
+        memmove(block - tail_size_, tail_, tail_size_);
+      }
+      // the previous view is done with, start reading ahead into its slot
+      if (holding_)
+        ring_.recycle(slot_);
+      slot_ = next;
+      holding_ = true;
+
+      if (ring_.eof(next)) {
+        eof_ = true;
+        if (size == 0)
+          return false;
+        // last row without a trailing newline
+        if (start[size - 1] != '\n') {
+          if (start == spill_.data()) {
+            spill_.push_back('\n');
+            start = spill_.data();
+          } else {
+            block[read] = '\n';
+          }
+          ++size;
+        }
+        view_ = start;
+        view_size_ = size;
+        return true;
+      }
+
+      auto newline = static_cast<const char *>(memrchr(start, '\n', size));
+      const size_t complete = newline ? static_cast<size_t>(newline - start) + 1 : 0;
+      tail_ = start + complete;
+      tail_size_ = size - complete;
+      if (complete == 0)
+        continue; // a single row spans the whole chunk
+      view_ = start;
+      view_size_ = complete;
+      return true;
+    }
+    return false;
+  }
+};
+
+// Streams a file through a ring of large aligned reads (io_uring, or pread
+// when that is unavailable) instead of mapping it.
+template <class delimiter = delimiter<','>, class quote_character = quote_character<'"'>,
+          class first_row_is_header = first_row_is_header<true>,
+          class trim_policy = trim_policy::trim_whitespace>
+using BlockReader =
+    BasicBlockReader<detail::BlockRing, delimiter, quote_character, first_row_is_header, trim_policy>;
+
+} // namespace csv2
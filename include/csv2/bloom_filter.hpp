@@ -0,0 +1,230 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <csv2/file_stamp.hpp>
+#include <csv2/filter.hpp>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace csv2 {
+
+// Bloom filters of the values of chosen columns (cells without surrounding
+// whitespace and quotes, as predicate::equals compares them), one per block
+// of `block_rows` data rows and one for the whole file. may_contain() is
+// never false for a value that is in the column, and false for most others,
+// so point lookups skip the blocks, or the whole file, that cannot hold the
+// value. Build it once the rows are indexed and save() it next to the file:
+// load() only reads the sidecar and the file's stamp (see file_stamp), so
+// checking many files does not index them, and a file rewritten since the
+// filter was built is never answered from it.
+class BloomFilter : public detail::row_blocks {
+  static constexpr uint32_t version_ = 3;
+  static constexpr double max_bits_per_value_ = 64; // 16 hashes gain nothing past ~25
+
+  file_stamp source_;
+  uint64_t block_bits_{0}; // bits of the filter of one block of one column
+  uint64_t file_bits_{0};  // bits of the filter of one whole column
+  uint32_t hashes_{0};
+  std::vector<uint64_t> columns_;   // indexed columns
+  std::vector<uint64_t> bits_;      // per column, per block: block_bits_ / 64 words
+  std::vector<uint64_t> file_words_; // per column: file_bits_ / 64 words
+
+  uint64_t *words_(size_t column, size_t block) {
+    return bits_.data() + (column * blocks() + block) * (block_bits_ / 64);
+  }
+  const uint64_t *words_(size_t column, size_t block) const {
+    return bits_.data() + (column * blocks() + block) * (block_bits_ / 64);
+  }
+
+  static uint64_t filter_bits_(uint64_t rows, double bits_per_value) {
+    return std::max<uint64_t>(64, uint64_t(std::ceil(rows * bits_per_value / 64)) * 64);
+  }
+
+  // Position of `col` in columns_, or columns_.size()
+  size_t column_(size_t col) const {
+    return std::find(columns_.begin(), columns_.end(), col) - columns_.begin();
+  }
+
+  // Bit positions from two halves of one hash (Kirsch-Mitzenmacher)
+  template <class F> void probes_(uint64_t hash, uint64_t bits, F &&f) const {
+    const uint64_t step = (hash >> 32) | 1;
+    for (uint32_t i = 0; i < hashes_; ++i, hash += step)
+      f(hash % bits);
+  }
+
+  bool test_(const uint64_t *words, uint64_t bits, uint64_t hash) const {
+    bool found = true;
+    probes_(hash, bits, [&](uint64_t bit) { found = found && (words[bit / 64] >> (bit % 64) & 1); });
+    return found;
+  }
+
+  void set_(uint64_t *words, uint64_t bits, uint64_t hash) const {
+    probes_(hash, bits, [&](uint64_t bit) { words[bit / 64] |= uint64_t(1) << (bit % 64); });
+  }
+
+public:
+  static std::string sidecar_path(const std::string &filename) { return filename + ".csv2bloom"; }
+
+  // One pass over the data rows indexed so far. About `bits_per_value` bits
+  // (1 to 64) are kept per row and column; 10 gives roughly 1% false
+  // positives.
+  template <class ReaderT>
+  bool build(const ReaderT &reader, std::vector<size_t> columns, size_t block_rows = 65536,
+             double bits_per_value = 10) {
+    *this = BloomFilter();
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+    if (columns.empty() || columns.back() >= reader.cols() || !(bits_per_value >= 1) ||
+        bits_per_value > max_bits_per_value_)
+      return false;
+    columns_.assign(columns.begin(), columns.end());
+    block_rows_ = std::max<size_t>(block_rows, 1);
+    source_ = file_stamp::of_reader(reader);
+    rows_ = reader.size();
+    block_bits_ = filter_bits_(std::min(block_rows_, rows_), bits_per_value);
+    file_bits_ = filter_bits_(rows_, bits_per_value);
+    hashes_ = std::clamp<uint32_t>(uint32_t(std::lround(bits_per_value * std::log(2.0))), 1, 16);
+    bits_.resize(columns_.size() * blocks() * (block_bits_ / 64));
+    file_words_.resize(columns_.size() * (file_bits_ / 64));
+
+    const auto quote = reader.get_quote_ch();
+    const size_t width = columns_.back() + 1;
+    auto it = reader.begin();
+    for (size_t irow = 0; irow < rows_; ++irow, ++it) {
+      const auto row = *it;
+      auto cell = row.begin();
+      for (size_t col = 0, column = 0; col < width; ++col, ++cell) {
+        if (col != columns_[column])
+          continue;
+        const auto hash = detail::hash_bytes(detail::strip_cell((*cell).raw_view(), quote));
+        set_(words_(column, irow / block_rows_), block_bits_, hash);
+        set_(file_words_.data() + column * (file_bits_ / 64), file_bits_, hash);
+        ++column;
+      }
+    }
+    return true;
+  }
+
+  bool save(const std::string &path) const {
+    detail::sidecar_writer out(path, "CSV2BLOM", version_, source_);
+    out.write(rows_);
+    out.write(block_rows_);
+    out.write(block_bits_);
+    out.write(file_bits_);
+    out.write(hashes_);
+    out.write(static_cast<uint64_t>(columns_.size()));
+    out.write(columns_.data(), columns_.size());
+    out.write(bits_.data(), bits_.size());
+    out.write(file_words_.data(), file_words_.size());
+    return out.close();
+  }
+
+  // Loads a filter saved for the file stamped `source`
+  bool load(const std::string &path, const file_stamp &source) {
+    detail::sidecar_reader in;
+    BloomFilter filter;
+    uint64_t count{0};
+    if (!in.open(path, "CSV2BLOM", version_, source) || !in.read(filter.rows_) ||
+        !in.read(filter.block_rows_) || !in.read(filter.block_bits_) || !in.read(filter.file_bits_) ||
+        !in.read(filter.hashes_) || !in.read(count) || filter.rows_ > source.size ||
+        filter.block_rows_ == 0 || filter.block_bits_ == 0 || filter.block_bits_ % 64 != 0 ||
+        filter.file_bits_ == 0 || filter.file_bits_ % 64 != 0 || filter.hashes_ == 0 || count == 0 ||
+        count > (uint64_t(1) << 20))
+      return false;
+    // no larger than build() makes them for these rows, and the words of all
+    // columns exactly what is left of the file, so a corrupt header can
+    // neither overflow the sizes nor leave the filters short
+    uint64_t column_words, block_words, file_words, words, bytes;
+    const auto rows = filter.rows_, block_rows = std::min(filter.block_rows_, rows);
+    if (filter.block_bits_ > filter_bits_(block_rows, max_bits_per_value_) ||
+        filter.file_bits_ > filter_bits_(rows, max_bits_per_value_) ||
+        !detail::checked_mul(filter.blocks(), filter.block_bits_ / 64, column_words) ||
+        !detail::checked_mul(count, column_words, block_words) ||
+        !detail::checked_mul(count, filter.file_bits_ / 64, file_words) ||
+        !detail::checked_add(block_words, file_words, words) ||
+        !detail::checked_add(words, count, words) ||
+        !detail::checked_mul(words, sizeof(uint64_t), bytes) || in.remaining() != bytes ||
+        !in.read(filter.columns_, count) || !in.read(filter.bits_, block_words) ||
+        !in.read(filter.file_words_, file_words))
+      return false;
+    filter.source_ = source;
+    *this = std::move(filter);
+    return true;
+  }
+
+  const auto &columns() const { return columns_; }
+  bool indexed(size_t col) const { return column_(col) < columns_.size(); }
+
+  // Whether `value` may be in column `col` of the block; always true for
+  // columns without a filter
+  bool may_contain(size_t block, size_t col, std::string_view value) const {
+    const auto column = column_(col);
+    return column == columns_.size() ||
+           test_(words_(column, block), block_bits_, detail::hash_bytes(value));
+  }
+
+  // Same for the whole file
+  bool may_contain(size_t col, std::string_view value) const {
+    const auto column = column_(col);
+    return column == columns_.size() ||
+           test_(file_words_.data() + column * (file_bits_ / 64), file_bits_, detail::hash_bytes(value));
+  }
+
+  // Row ranges [first, last) that may hold `value` in column `col`,
+  // adjacent blocks merged
+  std::vector<std::pair<size_t, size_t>> row_ranges(size_t col, std::string_view value) const {
+    return row_ranges_([&](size_t block) { return may_contain(block, col, value); });
+  }
+};
+
+namespace detail {
+
+// for_each_match() over the blocks of `filter` that may hold a value of an
+// equals or in_set predicate; other predicates, columns without a filter and
+// filters built over a different number of rows scan every row
+template <class ReaderT, class F>
+void for_each_match(const ReaderT &reader, size_t col, const predicate &test,
+                    const BloomFilter &filter, size_t size, F &&f) {
+  if ((test.type() != predicate::kind::equals && test.type() != predicate::kind::in_set) ||
+      !filter.indexed(col) || filter.rows() != size) {
+    for_each_match(reader, col, test, 0, size, f);
+    return;
+  }
+  for (size_t block = 0; block < filter.blocks(); ++block) {
+    const auto &values = test.values();
+    if (std::any_of(values.begin(), values.end(),
+                    [&](const std::string &value) { return filter.may_contain(block, col, value); })) {
+      const auto [first, last] = filter.block_span(block);
+      for_each_match(reader, col, test, first, last, f);
+    }
+  }
+}
+
+} // namespace detail
+
+// filter_bitmap() and filter_rows() reading only the blocks whose Bloom
+// filter may hold a value of an equals or in_set predicate
+template <class ReaderT>
+std::vector<uint64_t> filter_bitmap(const ReaderT &reader, size_t col, const predicate &test,
+                                    const BloomFilter &filter) {
+  const size_t size = reader.size();
+  std::vector<uint64_t> result((size + 63) / 64);
+  detail::for_each_match(reader, col, test, filter, size,
+                         [&](size_t irow) { result[irow / 64] |= uint64_t(1) << (irow % 64); });
+  return result;
+}
+
+template <class ReaderT>
+std::vector<size_t> filter_rows(const ReaderT &reader, size_t col, const predicate &test,
+                                const BloomFilter &filter) {
+  std::vector<size_t> result;
+  detail::for_each_match(reader, col, test, filter, reader.size(),
+                         [&](size_t irow) { result.push_back(irow); });
+  return result;
+}
+
+} // namespace csv2
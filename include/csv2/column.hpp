@@ -0,0 +1,330 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <csv2/reader.hpp>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace csv2 {
+
+namespace detail {
+
+// Cell bytes without surrounding whitespace and quotes
+inline std::string_view strip_cell(std::string_view value, char quote) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    value.remove_prefix(1);
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r'))
+    value.remove_suffix(1);
+  if (value.size() >= 2 && value.front() == quote && value.back() == quote)
+    value = value.substr(1, value.size() - 2);
+  return value;
+}
+
+// Parse a whole cell as a number, rejecting empty cells and trailing junk
+template <typename T> bool parse_number(std::string_view value, T &result, char quote = '"') {
+  value = strip_cell(value, quote);
+  if (!value.empty() && value.front() == '+')
+    value.remove_prefix(1);
+  if (value.empty())
+    return false;
+  const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+  return ec == std::errc() && ptr == value.data() + value.size();
+}
+
+// Value stored for a cell that is empty or not a number
+template <typename T> constexpr T missing_value() {
+  if constexpr (std::is_floating_point_v<T>)
+    return std::numeric_limits<T>::quiet_NaN();
+  else
+    return T{};
+}
+
+} // namespace detail
+
+// Column types, narrowest first: every integer cell is also a floating point
+// cell and every cell is a string
+enum class column_type { integer, floating, string };
+
+namespace detail {
+
+// Narrowest type of a non-empty cell
+inline column_type cell_type(std::string_view value, char quote) {
+  int64_t integer;
+  double floating;
+  if (parse_number(value, integer, quote))
+    return column_type::integer;
+  if (parse_number(value, floating, quote))
+    return column_type::floating;
+  return column_type::string;
+}
+
+// Days from 1970-01-01 to a date of the proleptic Gregorian calendar
+constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const auto yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// 64-bit hash of a byte string that is the same in every build, unlike
+// std::hash, so saved filters and indexes stay valid
+inline uint64_t hash_bytes(std::string_view value) {
+  uint64_t h = 0x9E3779B97F4A7C15ull ^ value.size();
+  size_t i = 0;
+  for (; i + 8 <= value.size(); i += 8) {
+    uint64_t word;
+    memcpy(&word, value.data() + i, 8);
+    h = mix64(h ^ word);
+  }
+  uint64_t tail = 0;
+  for (size_t shift = 0; i < value.size(); ++i, shift += 8)
+    tail |= uint64_t(static_cast<unsigned char>(value[i])) << shift;
+  return mix64(h ^ tail ^ 0xFF51AFD7ED558CCDull);
+}
+
+// Terminal columns taken by `value`: UTF-8 code points, continuation bytes
+// do not count
+inline size_t display_width(std::string_view value) {
+  size_t width = 0;
+  for (const auto c : value)
+    width += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+  return width;
+}
+
+} // namespace detail
+
+// Seconds since 1970-01-01 UTC of a cell holding a date, YYYY-MM-DD or
+// YYYYMMDD, optionally followed by 'T' or ' ' and HH:MM[:SS[.fraction]] and
+// a final 'Z'. No other time zones are accepted.
+inline bool parse_timestamp(std::string_view value, double &result, char quote = '"') {
+  value = detail::strip_cell(value, quote);
+  size_t i = 0;
+  const auto digits = [&](size_t n, unsigned &out) {
+    out = 0;
+    for (size_t end = i + n; i < end; ++i) {
+      if (i >= value.size() || value[i] < '0' || value[i] > '9')
+        return false;
+      out = out * 10 + unsigned(value[i] - '0');
+    }
+    return true;
+  };
+  const auto skip = [&](char c) { return i < value.size() && value[i] == c && ++i; };
+
+  unsigned year, month, day, hour = 0, minute = 0, second = 0;
+  if (!digits(4, year))
+    return false;
+  const bool dashes = skip('-');
+  if (!digits(2, month) || (dashes && !skip('-')) || !digits(2, day) || month < 1 || month > 12 ||
+      day < 1 || day > 31)
+    return false;
+  double fraction = 0;
+  if (skip('T') || skip(' ')) {
+    if (!digits(2, hour) || !skip(':') || !digits(2, minute) || hour > 23 || minute > 59)
+      return false;
+    if (skip(':')) {
+      if (!digits(2, second) || second > 60)
+        return false;
+      if (skip('.')) {
+        double scale = 0.1;
+        const auto start = i;
+        for (; i < value.size() && value[i] >= '0' && value[i] <= '9'; ++i, scale /= 10)
+          fraction += (value[i] - '0') * scale;
+        if (i == start)
+          return false;
+      }
+    }
+  }
+  skip('Z');
+  if (i != value.size())
+    return false;
+  result = double(detail::days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 +
+                  second) +
+           fraction;
+  return true;
+}
+
+// Raw bytes of cell `col` of `row`, empty if the row is shorter
+template <class RowT> std::string_view cell_view(const RowT &row, size_t col) {
+  auto it = row.begin();
+  for (size_t i = 0; i < col; ++i)
+    ++it;
+  return (*it).raw_view();
+}
+
+// Parse column `col` of every data row of `reader` into out[0, reader.size()).
+// Cells that are empty or not a number are stored as NaN for floating point
+// types and 0 for integers; returns how many cells that happened to.
+template <typename T, class ReaderT> size_t read_column(const ReaderT &reader, size_t col, T *out) {
+  static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "numeric column type expected");
+  size_t missing = 0;
+  // rows indexed after this point (see Reader::mmap_async) are not read
+  const auto end = out + reader.size();
+  for (auto it = reader.begin(); out != end; ++it) {
+    if (!detail::parse_number(cell_view(*it, col), *out, reader.get_quote_ch())) {
+      *out = detail::missing_value<T>();
+      ++missing;
+    }
+    ++out;
+  }
+  return missing;
+}
+
+// Guess the type of every column from `sample_rows` data rows spread evenly
+// over the file (all rows if there are fewer). Integer columns with empty
+// cells are reported as floating point so the gaps can be NaN; columns
+// without any value in the sample are floating point as well.
+template <class ReaderT>
+std::vector<column_type> infer_schema(const ReaderT &reader, size_t sample_rows = 1024) {
+  const size_t cols = reader.cols();
+  std::vector<column_type> types(cols, column_type::integer);
+  std::vector<bool> missing(cols, reader.size() == 0);
+  const size_t samples = std::min(reader.size(), sample_rows);
+  for (size_t i = 0; i < samples; ++i) {
+    const auto row = reader[i * reader.size() / samples];
+    auto cell = row.begin();
+    for (size_t col = 0; col < cols; ++col, ++cell) {
+      const auto value = detail::strip_cell((*cell).raw_view(), reader.get_quote_ch());
+      if (value.empty())
+        missing[col] = true;
+      else if (types[col] != column_type::string)
+        types[col] = std::max(types[col], detail::cell_type(value, reader.get_quote_ch()));
+    }
+  }
+  for (size_t col = 0; col < cols; ++col)
+    if (types[col] == column_type::integer && missing[col])
+      types[col] = column_type::floating;
+  return types;
+}
+
+// Where read_columns stores one column: reader.size() integers, doubles or
+// cell views (without surrounding quotes, escaped quotes left as they are)
+using column_destination = std::variant<int64_t *, double *, std::string_view *>;
+
+struct column_output {
+  size_t col;
+  column_destination data;
+  size_t missing{0}; // empty cells: 0, NaN or an empty view
+  size_t invalid{0}; // non-empty cells that are not a number, stored like empty ones
+};
+
+// Fill several columns in a single pass over the rows, each row's cells
+// being walked once however many columns are requested
+template <class ReaderT> void read_columns(const ReaderT &reader, column_output *columns, size_t n) {
+  size_t width = 0;
+  for (size_t i = 0; i < n; ++i)
+    width = std::max(width, columns[i].col + 1);
+  std::vector<std::string_view> cells(width);
+  const auto quote = reader.get_quote_ch();
+
+  const size_t size = reader.size();
+  auto it = reader.begin();
+  for (size_t irow = 0; irow < size; ++irow, ++it) {
+    const auto row = *it;
+    auto cell = row.begin();
+    for (size_t col = 0; col < width; ++col, ++cell)
+      cells[col] = (*cell).raw_view();
+
+    for (size_t i = 0; i < n; ++i) {
+      auto &column = columns[i];
+      const auto value = detail::strip_cell(cells[column.col], quote);
+      std::visit(
+          [&](auto data) {
+            using T = std::remove_pointer_t<decltype(data)>;
+            if constexpr (std::is_same_v<T, std::string_view>) {
+              data[irow] = value;
+              column.missing += value.empty();
+            } else if (!detail::parse_number(value, data[irow], quote)) {
+              data[irow] = detail::missing_value<T>();
+              ++(value.empty() ? column.missing : column.invalid);
+            }
+          },
+          column.data);
+    }
+  }
+}
+
+struct width_sample_options {
+  size_t head{1000};        // first data rows
+  size_t tail{1000};        // last data rows
+  size_t strided{1000};     // rows spread evenly over the rest of the file
+  double percentile{0.95};  // reported besides the maximum
+};
+
+// Display widths of the sampled cells of one kind of row
+struct column_width_stats {
+  size_t rows{0};
+  std::vector<size_t> max;        // per column
+  std::vector<size_t> percentile; // per column, options.percentile of the sampled widths
+};
+
+// Cell widths (as shown by Cell::as_string) over a sample of the data rows,
+// grouped by the prefix before ':' of their first cell, the same key that
+// tells the header rows apart. The head is walked from begin(), so it is
+// available while Reader::mmap_async() is still indexing; the tail and the
+// strided rows come from the rows indexed so far. Only the sampled rows are
+// touched, so the cost does not depend on the file size.
+template <class ReaderT>
+std::map<std::string, column_width_stats> column_widths(const ReaderT &reader,
+                                                        width_sample_options options = {}) {
+  const size_t cols = reader.cols();
+  std::map<std::string, std::vector<std::vector<size_t>>> widths; // prefix -> column -> widths
+  const auto add = [&](const auto &row) {
+    auto cell = row.begin();
+    auto first = *cell;
+    auto &columns = widths[std::string(first.get_prefix(':'))];
+    columns.resize(cols);
+    for (size_t col = 0; col < cols; ++col, ++cell)
+      columns[col].push_back(detail::display_width((*cell).as_string()));
+  };
+
+  size_t head = 0;
+  for (auto it = reader.begin(), end = reader.end(); head < options.head && it != end; ++it, ++head)
+    add(*it);
+
+  const size_t size = reader.size();
+  std::vector<size_t> sample;
+  for (size_t i = size - std::min(options.tail, size); i < size; ++i)
+    sample.push_back(i);
+  for (size_t i = 0; i < std::min(options.strided, size); ++i)
+    sample.push_back(i * size / std::min(options.strided, size));
+  std::sort(sample.begin(), sample.end());
+  sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+  for (const auto irow : sample)
+    if (irow >= head)
+      add(reader[irow]);
+
+  std::map<std::string, column_width_stats> result;
+  for (auto &[prefix, columns] : widths) {
+    auto &stats = result[prefix];
+    stats.rows = columns.empty() ? 0 : columns.front().size();
+    for (auto &column : columns) {
+      stats.max.push_back(*std::max_element(column.begin(), column.end()));
+      // nearest rank
+      const auto rank = static_cast<size_t>(std::clamp<double>(
+                            std::ceil(options.percentile * column.size()), 1.0, column.size())) - 1;
+      std::nth_element(column.begin(), column.begin() + rank, column.end());
+      stats.percentile.push_back(column[rank]);
+    }
+  }
+  return result;
+}
+
+} // namespace csv2
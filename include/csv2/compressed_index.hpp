@@ -0,0 +1,463 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <csv2/compressed_reader.hpp>
+#include <csv2/file_stamp.hpp>
+#include <csv2/mio.hpp>
+#include <csv2/reader.hpp>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace csv2 {
+
+// Maps row numbers of a (possibly compressed) CSV file to points where
+// decompression can start: every zstd frame, every gzip member, and for gzip
+// streams a deflate block boundary with its 32 KiB window every `span` bytes
+// of output. Build it once and save() it next to the file to reuse it; the
+// saved index is only used for the file it was built from (see file_stamp).
+class CompressedIndex {
+public:
+  struct Checkpoint {
+    uint64_t compressed_offset{0};   // where decoding resumes in the file
+    uint64_t uncompressed_offset{0}; // first text byte produced from there
+    uint64_t newlines_before{0};     // '\n' in the text before uncompressed_offset
+    uint8_t bits{0};                 // gzip: bits of the byte before compressed_offset still to decode
+    bool line_start{true};           // uncompressed_offset starts a row
+    std::string window;              // gzip: last 32 KiB of text, empty at a member start
+  };
+
+private:
+  static constexpr uint32_t version_ = 3;
+  static constexpr size_t gzip_window_ = 32768;
+
+  compression format_{compression::none};
+  file_stamp source_;
+  uint64_t uncompressed_size_{0};
+  uint64_t newlines_{0};
+  bool ends_with_newline_{true};
+  std::vector<Checkpoint> checkpoints_;
+
+public:
+  static std::string sidecar_path(const std::string &filename) { return filename + ".csv2idx"; }
+
+  // Decompresses the file once, counting rows and recording a checkpoint at
+  // least every `span` bytes of text (zstd: at most one per frame)
+  bool build(const std::string &filename, size_t span = 4 * 1024 * 1024) {
+    std::error_code error;
+    mio::mmap_source mmap;
+    mmap.map(filename, error);
+    if (error)
+      return false;
+    return build(mmap.data(), mmap.mapped_length(), span, mmap.file_handle());
+  }
+
+  // `handle` is the open file behind the input, if any, for load() to tell
+  // it apart from a rewrite of the same size
+  bool build(const char *input, size_t input_size, size_t span = 4 * 1024 * 1024,
+             mio::file_handle_type handle = mio::invalid_handle) {
+    *this = CompressedIndex();
+    format_ = detect_compression(input, input_size);
+    source_ = file_stamp::of(input, input_size, handle);
+    span = std::max<size_t>(span, 1);
+    bool built = false;
+    switch (format_) {
+    case compression::none:
+      built = build_plain_(input, input_size, span);
+      break;
+    case compression::gzip:
+      built = build_gzip_(input, input_size, span);
+      break;
+    case compression::zstd:
+      built = build_zstd_(input, input_size, span);
+      break;
+    }
+    if (!built)
+      *this = CompressedIndex();
+    return built;
+  }
+
+  bool save(const std::string &path) const {
+    detail::sidecar_writer out(path, "CSV2CIDX", version_, source_);
+    out.write(static_cast<uint8_t>(format_));
+    out.write(uncompressed_size_);
+    out.write(newlines_);
+    out.write(static_cast<uint8_t>(ends_with_newline_));
+    out.write(static_cast<uint64_t>(checkpoints_.size()));
+    for (const auto &checkpoint : checkpoints_) {
+      out.write(checkpoint.compressed_offset);
+      out.write(checkpoint.uncompressed_offset);
+      out.write(checkpoint.newlines_before);
+      out.write(checkpoint.bits);
+      out.write(static_cast<uint8_t>(checkpoint.line_start));
+      out.write(static_cast<uint32_t>(checkpoint.window.size()));
+      out.write(checkpoint.window.data(), checkpoint.window.size());
+    }
+    return out.close();
+  }
+
+  // Loads an index saved for the file stamped `source`
+  bool load(const std::string &path, const file_stamp &source) {
+    detail::sidecar_reader in;
+    CompressedIndex index;
+    uint8_t format{0}, ends_with_newline{0};
+    uint64_t count{0};
+    if (!in.open(path, "CSV2CIDX", version_, source) || !in.read(format) ||
+        !in.read(index.uncompressed_size_) || !in.read(index.newlines_) ||
+        !in.read(ends_with_newline) || !in.read(count) || format > 2)
+      return false;
+    index.source_ = source;
+    index.format_ = static_cast<compression>(format);
+    index.ends_with_newline_ = ends_with_newline != 0;
+    for (uint64_t i = 0; i < count; ++i) {
+      Checkpoint checkpoint;
+      uint8_t line_start{0};
+      uint32_t window_size{0};
+      std::vector<char> window;
+      if (!in.read(checkpoint.compressed_offset) || !in.read(checkpoint.uncompressed_offset) ||
+          !in.read(checkpoint.newlines_before) || !in.read(checkpoint.bits) || !in.read(line_start) ||
+          !in.read(window_size) || window_size > gzip_window_ || !in.read(window, window_size))
+        return false;
+      checkpoint.line_start = line_start != 0;
+      checkpoint.window.assign(window.begin(), window.end());
+      index.checkpoints_.push_back(std::move(checkpoint));
+    }
+    if (index.checkpoints_.empty() || in.remaining() != 0)
+      return false;
+    *this = std::move(index);
+    return true;
+  }
+
+  auto format() const { return format_; }
+  auto compressed_size() const { return source_.size; }
+  const auto &source() const { return source_; }
+  auto uncompressed_size() const { return uncompressed_size_; }
+  const auto &checkpoints() const { return checkpoints_; }
+  bool empty() const { return checkpoints_.empty(); }
+
+  // Rows of text, an unterminated last row included
+  uint64_t rows() const { return newlines_ + (ends_with_newline_ ? 0 : 1); }
+
+  // Index of the checkpoint to start decoding from to reach row `line`
+  // (counted from the first line of the file)
+  size_t locate(uint64_t line) const {
+    // the row starts after its line-th '\n', which comes after the last
+    // checkpoint with fewer newlines before it
+    auto it = std::lower_bound(checkpoints_.begin(), checkpoints_.end(), line,
+                               [](const Checkpoint &checkpoint, uint64_t value) {
+                                 return checkpoint.newlines_before < value;
+                               });
+    return it == checkpoints_.begin() ? 0 : static_cast<size_t>(it - checkpoints_.begin()) - 1;
+  }
+
+private:
+  void count_(const char *text, size_t size) {
+    for (auto p = text, end = text + size; (p = static_cast<const char *>(memchr(p, '\n', end - p))); ++p)
+      ++newlines_;
+    if (size > 0)
+      ends_with_newline_ = text[size - 1] == '\n';
+    uncompressed_size_ += size;
+  }
+
+  void checkpoint_(uint64_t compressed_offset, uint8_t bits = 0, std::string window = std::string()) {
+    Checkpoint checkpoint;
+    checkpoint.compressed_offset = compressed_offset;
+    checkpoint.uncompressed_offset = uncompressed_size_;
+    checkpoint.newlines_before = newlines_;
+    checkpoint.bits = bits;
+    checkpoint.line_start = ends_with_newline_;
+    checkpoint.window = std::move(window);
+    checkpoints_.push_back(std::move(checkpoint));
+  }
+
+  bool build_plain_(const char *input, size_t input_size, size_t span) {
+    for (size_t offset = 0; offset < input_size || offset == 0; offset += span) {
+      checkpoint_(offset);
+      count_(input + offset, std::min(span, input_size - offset));
+      if (input_size == 0)
+        break;
+    }
+    return true;
+  }
+
+  bool build_gzip_(const char *input, size_t input_size, size_t span) {
+#ifdef CSV2_WITH_ZLIB
+    // after zlib's examples/zran.c: stop at every deflate block boundary with
+    // Z_BLOCK and keep the sliding window of whichever boundaries we index
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)
+      return false;
+    std::vector<char> window(gzip_window_);
+    size_t consumed = 0;
+    uint64_t last = 0;
+    int ret = Z_OK;
+    checkpoint_(0);
+    while (true) {
+      if (stream.avail_in == 0) {
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input + consumed));
+        stream.avail_in = static_cast<uInt>(std::min<size_t>(input_size - consumed, 1u << 30));
+      }
+      if (stream.avail_out == 0) {
+        stream.next_out = reinterpret_cast<Bytef *>(window.data());
+        stream.avail_out = static_cast<uInt>(window.size());
+      }
+      const auto out = reinterpret_cast<const char *>(stream.next_out);
+      const auto avail_in = stream.avail_in;
+      ret = inflate(&stream, Z_BLOCK);
+      consumed += avail_in - stream.avail_in;
+      count_(out, reinterpret_cast<const char *>(stream.next_out) - out);
+
+      if (ret == Z_STREAM_END) {
+        if (consumed >= input_size)
+          break;
+        // another member follows, its header can be parsed from scratch
+        if (inflateReset(&stream) != Z_OK)
+          break;
+        if (uncompressed_size_ - last >= span) {
+          checkpoint_(consumed);
+          last = uncompressed_size_;
+        }
+        continue;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+        break;
+      if (ret == Z_BUF_ERROR && consumed >= input_size)
+        break; // truncated
+
+      // end of a block that is not the last one of the member
+      if ((stream.data_type & 128) && !(stream.data_type & 64) && uncompressed_size_ - last >= span) {
+        // unroll the circular window, oldest bytes first
+        const size_t left = stream.avail_out;
+        std::string history(window.data() + window.size() - left, left);
+        history.append(window.data(), window.size() - left);
+        checkpoint_(consumed, static_cast<uint8_t>(stream.data_type & 7), std::move(history));
+        last = uncompressed_size_;
+      }
+    }
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END;
+#else
+    (void)(input), (void)(input_size), (void)(span);
+    return false;
+#endif
+  }
+
+  bool build_zstd_(const char *input, size_t input_size, size_t span) {
+#ifdef CSV2_WITH_ZSTD
+    // frames are the only places a zstd stream can be entered, seekable zstd
+    // files just make them small
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+    if (!context)
+      return false;
+    std::vector<char> text(ZSTD_DStreamOutSize());
+    uint64_t last = 0;
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < input_size;) {
+      const auto size = ZSTD_findFrameCompressedSize(input + offset, input_size - offset);
+      if (ZSTD_isError(size)) {
+        ok = false;
+        break;
+      }
+      if (!detail::is_zstd_skippable_frame(input + offset, size)) {
+        if (checkpoints_.empty() || uncompressed_size_ - last >= span) {
+          checkpoint_(offset);
+          last = uncompressed_size_;
+        }
+        ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+        ZSTD_inBuffer in{input + offset, size, 0};
+        size_t hint = 1;
+        while (hint != 0) {
+          ZSTD_outBuffer out{text.data(), text.size(), 0};
+          hint = ZSTD_decompressStream(context, &out, &in);
+          if (ZSTD_isError(hint) || (hint != 0 && in.pos == in.size && out.pos < out.size)) {
+            ok = false;
+            break;
+          }
+          count_(text.data(), out.pos);
+        }
+      }
+      offset += size;
+    }
+    ZSTD_freeDCtx(context);
+    if (checkpoints_.empty())
+      checkpoint_(0);
+    return ok;
+#else
+    (void)(input), (void)(input_size), (void)(span);
+    return false;
+#endif
+  }
+};
+
+// Random access by row into a plain, gzip or zstd file through a
+// CompressedIndex: a lookup decompresses from the closest checkpoint only,
+// and keeps that stretch of text around for nearby rows. A Row stays valid
+// until a lookup outside the cached stretch.
+template <class delimiter = delimiter<','>, class quote_character = quote_character<'"'>,
+          class first_row_is_header = first_row_is_header<true>,
+          class trim_policy = trim_policy::trim_whitespace>
+class SeekableReader {
+  using ReaderT = Reader<delimiter, quote_character, first_row_is_header, trim_policy>;
+
+  mio::mmap_source mmap_;
+  CompressedIndex index_;
+  size_t span_{4 * 1024 * 1024};  // text decoded per lookup
+  ReaderT header_;                // parses the header rows out of header_bytes_
+  std::string header_bytes_;
+  size_t header_rows_{0};
+  std::string window_;            // decoded text holding complete rows
+  std::vector<size_t> starts_;    // row start offsets in window_
+  uint64_t first_line_{0};        // line number of starts_[0]
+
+public:
+  using Row = typename ReaderT::Row;
+  using Cell = typename ReaderT::Cell;
+
+  SeekableReader() = default;
+  SeekableReader(const SeekableReader &) = delete;
+  SeekableReader &operator=(const SeekableReader &) = delete;
+
+  // Uses the sidecar index next to the file when it is still valid, builds
+  // one in memory otherwise
+  template <typename StringType> bool open(StringType &&filename, size_t span = 4 * 1024 * 1024) {
+    const std::string path(filename);
+    if (!map_(path))
+      return false;
+    CompressedIndex index;
+    if (!index.load(CompressedIndex::sidecar_path(path), stamp_()) &&
+        !index.build(mmap_.data(), mmap_.mapped_length(), span, mmap_.file_handle()))
+      return false;
+    return open_(std::move(index), span);
+  }
+
+  // With an index built for this file; one built from a buffer has to match
+  // its size and contents only
+  template <typename StringType> bool open(StringType &&filename, CompressedIndex index) {
+    if (!map_(std::string(filename)))
+      return false;
+    auto stamp = stamp_();
+    if (index.source().mtime_ns == 0)
+      stamp = file_stamp::of(mmap_.data(), mmap_.mapped_length());
+    if (index.source() != stamp)
+      return false;
+    return open_(std::move(index), span_);
+  }
+
+  const CompressedIndex &index() const { return index_; }
+  const auto &header() const { return header_.header(); }
+  auto cols() const { return header_.cols(); }
+  auto rows() const { return index_.rows(); }
+  auto size() const { return index_.rows() - header_rows_; }
+
+  Row operator[](size_t irow) {
+    if (irow >= size())
+      throw std::out_of_range("row " + std::to_string(irow) + " not in range [0," +
+                              std::to_string(size()) + ")");
+    const uint64_t line = irow + header_rows_;
+    if (line < first_line_ || line >= first_line_ + starts_.size())
+      load_(line);
+    auto it = typename ReaderT::RowIterator(window_.data(), window_.size(), starts_[line - first_line_],
+                                            static_cast<int64_t>(irow), header_.col_cnt_);
+    return *it;
+  }
+
+private:
+  bool map_(const std::string &path) {
+    std::error_code error;
+    mmap_.map(path, error);
+    return !error;
+  }
+
+  file_stamp stamp_() const {
+    return file_stamp::of(mmap_.data(), mmap_.mapped_length(), mmap_.file_handle());
+  }
+
+  bool open_(CompressedIndex index, size_t span) {
+    index_ = std::move(index);
+    span_ = std::max<size_t>(span, 1);
+    window_.clear();
+    starts_.clear();
+    first_line_ = 0;
+    header_rows_ = 0;
+    header_bytes_.clear();
+    header_.buffer_ = header_bytes_.data();
+    header_.buffer_size_ = 0;
+    header_.init_();
+    if (index_.rows() == 0)
+      return true;
+
+    // header rows come from the start of the text
+    load_(0);
+    header_.buffer_ = window_.data();
+    header_.buffer_size_ = window_.size();
+    header_.init_();
+    const auto header_size =
+        header_.headers_.empty() ? 0 : std::min(header_.header_indices_().second + 1, window_.size());
+    header_bytes_.assign(window_.data(), header_size);
+    header_.buffer_ = header_bytes_.data();
+    header_.buffer_size_ = header_bytes_.size();
+    header_.init_();
+    header_rows_ = header_.headers_.size();
+    return true;
+  }
+
+  // Decodes about span_ bytes of complete rows, starting with row `line`
+  void load_(uint64_t line) {
+    const auto &checkpoint = index_.checkpoints()[index_.locate(line)];
+    detail::StreamDecoder decoder;
+    if (!decoder.open(index_.format(), mmap_.data(), mmap_.mapped_length(), checkpoint.compressed_offset,
+                      checkpoint.bits, checkpoint.window.data(), checkpoint.window.size()))
+      throw std::runtime_error("csv2: cannot resume decompression at checkpoint");
+
+    window_.clear();
+    starts_.clear();
+    uint64_t seen = checkpoint.newlines_before; // '\n' decoded before p
+    bool line_start = checkpoint.line_start;   // p starts row `seen`
+    bool started = false;
+    std::vector<char> text(std::min<size_t>(span_, 1024 * 1024));
+    while (true) {
+      const auto n = decoder.fill(text.data(), text.size());
+      if (n < 0)
+        throw std::runtime_error("csv2: corrupt or truncated input");
+      if (n == 0)
+        break;
+      const char *p = text.data(), *end = p + n;
+      // skip to the start of the requested row
+      while (!started) {
+        if (line_start && seen == line) {
+          started = true;
+          break;
+        }
+        auto newline = p == end ? nullptr : static_cast<const char *>(memchr(p, '\n', end - p));
+        line_start = newline != nullptr;
+        if (!newline)
+          break;
+        p = newline + 1;
+        ++seen;
+      }
+      if (!started)
+        continue;
+      window_.append(p, end);
+      // stop at a row boundary once there is enough text
+      if (window_.size() >= span_) {
+        const auto last = window_.rfind('\n');
+        if (last != std::string::npos) {
+          window_.resize(last + 1);
+          break;
+        }
+      }
+    }
+    if (!started)
+      throw std::out_of_range("csv2: row " + std::to_string(line) + " is past the end of the input");
+
+    first_line_ = line;
+    starts_.push_back(0);
+    for (const char *p = window_.data(), *end = p + window_.size();
+         (p = static_cast<const char *>(memchr(p, '\n', end - p))) && ++p < end;)
+      starts_.push_back(p - window_.data());
+  }
+};
+
+} // namespace csv2
@@ -0,0 +1,481 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <csv2/block_reader.hpp>
+#include <csv2/mio.hpp>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#ifdef CSV2_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV2_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace csv2 {
+
+enum class compression { none, gzip, zstd };
+
+struct decompress_options {
+  size_t chunk_size{4 * 1024 * 1024}; // decompressed bytes handed to the parser at a time
+  size_t queue_depth{4};              // chunks decompressed ahead of the parser
+  size_t carry_capacity{64 * 1024};   // room in front of each chunk for a row split by the previous one
+  size_t threads{0};                  // zstd frame decoders, 0 = hardware concurrency
+};
+
+namespace detail {
+
+inline uint32_t read_le32(const char *data) {
+  const auto bytes = reinterpret_cast<const unsigned char *>(data);
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+inline bool is_zstd_skippable_frame(const char *data, size_t size) {
+  return size >= 4 && (read_le32(data) & 0xFFFFFFF0) == 0x184D2A50;
+}
+
+} // namespace detail
+
+// Sniffs the compression format from the first bytes of the input
+inline compression detect_compression(const char *data, size_t size) {
+  const auto bytes = reinterpret_cast<const unsigned char *>(data);
+  if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+    return compression::gzip;
+  // regular frame, or a skippable frame in front of one
+  if (size >= 4 && (detail::read_le32(data) == 0xFD2FB528 || detail::is_zstd_skippable_frame(data, size)))
+    return compression::zstd;
+  return compression::none;
+}
+
+namespace detail {
+
+// Decodes one compressed stream sequentially, `chunk` bytes at a time
+class StreamDecoder {
+  compression format_{compression::none};
+  const char *input_{nullptr};
+  size_t input_size_{0};
+  size_t consumed_{0};
+#ifdef CSV2_WITH_ZLIB
+  z_stream zlib_{};
+  bool zlib_open_{false};
+  bool raw_{false}; // started inside a deflate stream, the gzip trailer still follows
+#endif
+#ifdef CSV2_WITH_ZSTD
+  ZSTD_DCtx *zstd_{nullptr};
+  size_t zstd_hint_{0}; // last ZSTD_decompressStream result, 0 once a frame is flushed
+#endif
+
+public:
+  StreamDecoder() = default;
+  StreamDecoder(const StreamDecoder &) = delete;
+  StreamDecoder &operator=(const StreamDecoder &) = delete;
+  ~StreamDecoder() { close(); }
+
+  static bool supports(compression format) {
+    switch (format) {
+    case compression::none:
+      return true;
+    case compression::gzip:
+#ifdef CSV2_WITH_ZLIB
+      return true;
+#else
+      return false;
+#endif
+    case compression::zstd:
+#ifdef CSV2_WITH_ZSTD
+      return true;
+#else
+      return false;
+#endif
+    }
+    return false;
+  }
+
+  bool open(compression format, const char *input, size_t input_size) {
+    return open(format, input, input_size, 0, 0, nullptr, 0);
+  }
+
+  // Starts decoding at a checkpoint: the start of a gzip member or zstd frame
+  // at `offset`, or, with a deflate `window`, a deflate block boundary that
+  // begins `bits` bits before `offset`
+  bool open(compression format, const char *input, size_t input_size, size_t offset, int bits,
+            const char *window, size_t window_size) {
+    close();
+    format_ = format;
+    input_ = input;
+    input_size_ = input_size;
+    consumed_ = std::min(offset, input_size);
+#ifdef CSV2_WITH_ZLIB
+    if (format_ == compression::gzip) {
+      zlib_ = z_stream{};
+      raw_ = window_size > 0;
+      // 32: accept both gzip and zlib headers, negative: raw deflate
+      if (inflateInit2(&zlib_, raw_ ? -15 : 15 + 32) != Z_OK)
+        return false;
+      zlib_open_ = true;
+      if (raw_ && bits > 0) {
+        if (consumed_ == 0)
+          return false;
+        --consumed_;
+        const auto byte = static_cast<unsigned char>(input_[consumed_++]);
+        if (inflatePrime(&zlib_, bits, byte >> (8 - bits)) != Z_OK)
+          return false;
+      }
+      if (raw_ && inflateSetDictionary(&zlib_, reinterpret_cast<const Bytef *>(window),
+                                       static_cast<uInt>(window_size)) != Z_OK)
+        return false;
+    }
+#else
+    (void)(bits), (void)(window), (void)(window_size);
+#endif
+#ifdef CSV2_WITH_ZSTD
+    if (format_ == compression::zstd) {
+      zstd_ = ZSTD_createDCtx();
+      zstd_hint_ = 0;
+      if (!zstd_)
+        return false;
+    }
+#endif
+    return supports(format_);
+  }
+
+  void close() {
+#ifdef CSV2_WITH_ZLIB
+    if (zlib_open_)
+      inflateEnd(&zlib_);
+    zlib_open_ = false;
+#endif
+#ifdef CSV2_WITH_ZSTD
+    if (zstd_)
+      ZSTD_freeDCtx(zstd_);
+    zstd_ = nullptr;
+#endif
+  }
+
+  // Fills up to `capacity` bytes, returns the number written (0 at the end
+  // of the input) or -errno on corrupt or truncated input
+  long fill(char *output, size_t capacity) {
+    switch (format_) {
+    case compression::none: {
+      const auto n = std::min(capacity, input_size_ - consumed_);
+      memcpy(output, input_ + consumed_, n);
+      consumed_ += n;
+      return static_cast<long>(n);
+    }
+    case compression::gzip:
+      return fill_gzip_(output, capacity);
+    case compression::zstd:
+      return fill_zstd_(output, capacity);
+    }
+    return -EINVAL;
+  }
+
+private:
+  long fill_gzip_(char *output, size_t capacity) {
+#ifdef CSV2_WITH_ZLIB
+    size_t produced = 0;
+    while (produced < capacity && consumed_ < input_size_) {
+      // avail_in/avail_out are 32 bit
+      const auto in = std::min<size_t>(input_size_ - consumed_, 1u << 30);
+      const auto out = std::min<size_t>(capacity - produced, 1u << 30);
+      zlib_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input_ + consumed_));
+      zlib_.avail_in = static_cast<uInt>(in);
+      zlib_.next_out = reinterpret_cast<Bytef *>(output + produced);
+      zlib_.avail_out = static_cast<uInt>(out);
+      const auto ret = inflate(&zlib_, Z_NO_FLUSH);
+      consumed_ += in - zlib_.avail_in;
+      produced += out - zlib_.avail_out;
+      if (ret == Z_STREAM_END) {
+        if (raw_) {
+          // skip the member's CRC32/ISIZE trailer and parse headers again
+          consumed_ = std::min(consumed_ + 8, input_size_);
+          raw_ = false;
+          if (consumed_ < input_size_ && inflateReset2(&zlib_, 15 + 32) != Z_OK)
+            return -EIO;
+        }
+        // concatenated members (pigz, cat a.gz b.gz) continue the same text
+        else if (consumed_ < input_size_ && inflateReset(&zlib_) != Z_OK)
+          return -EIO;
+      } else if (ret != Z_OK && !(ret == Z_BUF_ERROR && zlib_.avail_out == 0)) {
+        return -EIO;
+      } else if (ret == Z_OK && consumed_ == input_size_ && zlib_.avail_out != 0) {
+        return -EIO; // truncated
+      }
+    }
+    return static_cast<long>(produced);
+#else
+    (void)(output), (void)(capacity);
+    return -ENOTSUP;
+#endif
+  }
+
+  long fill_zstd_(char *output, size_t capacity) {
+#ifdef CSV2_WITH_ZSTD
+    ZSTD_inBuffer in{input_, input_size_, consumed_};
+    ZSTD_outBuffer out{output, capacity, 0};
+    // stop once all input is consumed and the last frame is flushed
+    while (out.pos < out.size && (in.pos < in.size || zstd_hint_ != 0)) {
+      const auto before_in = in.pos, before_out = out.pos;
+      zstd_hint_ = ZSTD_decompressStream(zstd_, &out, &in);
+      if (ZSTD_isError(zstd_hint_))
+        return -EIO;
+      if (in.pos == before_in && out.pos == before_out)
+        return -EIO; // truncated
+    }
+    consumed_ = in.pos;
+    return static_cast<long>(out.pos);
+#else
+    (void)(output), (void)(capacity);
+    return -ENOTSUP;
+#endif
+  }
+};
+
+// Source for BasicBlockReader that decompresses a mapped .gz/.zst (or plain)
+// file on background threads into a ring of chunks, so parsing overlaps with
+// decompression. Chunk k always lands in slot k % slots(). A zstd file made
+// of several independent frames (pzstd, zstd --seekable, concatenated .zst)
+// has its frames decoded in parallel, one frame per chunk, when every frame
+// declares a content size of at most parallel_frame_chunks_ chunks; other
+// files stream through one decoder so memory stays at a chunk per slot.
+class DecompressRing {
+  static constexpr size_t parallel_frame_chunks_ = 4;
+
+  struct Slot {
+    std::vector<char> memory; // [carry][chunk][1]
+    size_t ticket{0};         // index of the chunk this slot is waiting for
+    long result{0};           // bytes in the chunk, -errno on failure
+    bool ready{false};
+    bool last{false};         // no chunk follows this one
+  };
+
+  mio::mmap_source mmap_;
+  compression format_{compression::none};
+  size_t chunk_size_{0};
+  size_t carry_{0};
+  std::vector<Slot> slots_;
+  std::vector<std::pair<size_t, size_t>> frames_; // offset/size of zstd frames decoded in parallel
+  std::atomic<size_t> next_frame_{0};
+  std::mutex mutex_;
+  std::condition_variable produced_, consumed_;
+  bool stop_{false};
+  std::vector<std::thread> workers_;
+
+public:
+  DecompressRing() = default;
+  DecompressRing(const DecompressRing &) = delete;
+  DecompressRing &operator=(const DecompressRing &) = delete;
+  ~DecompressRing() { close(); }
+
+  bool open(const std::string &filename, const decompress_options &options = decompress_options{}) {
+    close();
+    std::error_code error;
+    mmap_.map(filename, error);
+    if (error)
+      return false;
+    const auto input = mmap_.data();
+    const auto input_size = mmap_.mapped_length();
+    format_ = detect_compression(input, input_size);
+    if (!StreamDecoder::supports(format_))
+      return false;
+
+    chunk_size_ = std::max<size_t>(options.chunk_size, 1);
+    carry_ = options.carry_capacity;
+    auto threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+#ifdef CSV2_WITH_ZSTD
+    if (format_ == compression::zstd && threads > 1)
+      split_frames_(input, input_size);
+#endif
+    if (frames_.size() < 2) {
+      frames_.clear();
+      threads = 1;
+    }
+    threads = std::min(threads, frames_.size() ? frames_.size() : 1);
+    // keep every decoder busy while the parser holds one chunk
+    slots_.resize(std::max(options.queue_depth, threads + 1));
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].ticket = i;
+      if (frames_.empty())
+        slots_[i].memory.resize(carry_ + chunk_size_ + 1);
+    }
+
+    stop_ = false;
+    next_frame_ = 0;
+#ifdef CSV2_WITH_ZSTD
+    for (size_t i = 0; i < threads && !frames_.empty(); ++i)
+      workers_.emplace_back([this, input] { decode_frames_(input); });
+#endif
+    if (frames_.empty())
+      workers_.emplace_back([this, input, input_size] { decode_stream_(input, input_size); });
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    consumed_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+    workers_.clear();
+    slots_.clear();
+    frames_.clear();
+    if (mmap_.is_mapped())
+      mmap_.unmap();
+  }
+
+  auto slots() const { return slots_.size(); }
+  auto carry() const { return carry_; }
+  auto format() const { return format_; }
+  // Frames decoded in parallel, 0 when the input is decoded as one stream
+  auto frames() const { return frames_.size(); }
+
+  char *data(size_t i) { return slots_[i].memory.data() + carry_; }
+  bool eof(size_t i) const { return slots_[i].last; }
+
+  long wait(size_t i) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    produced_.wait(lock, [&] { return slots_[i].ready; });
+    return slots_[i].result;
+  }
+
+  void recycle(size_t i) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto &slot = slots_[i];
+      slot.ready = slot.last = false;
+      slot.ticket += slots_.size();
+    }
+    consumed_.notify_all();
+  }
+
+private:
+  // Blocks until the slot for chunk `ticket` has been handed back
+  Slot *acquire_(size_t ticket) {
+    auto &slot = slots_[ticket % slots_.size()];
+    std::unique_lock<std::mutex> lock(mutex_);
+    consumed_.wait(lock, [&] { return stop_ || (slot.ticket == ticket && !slot.ready); });
+    return stop_ ? nullptr : &slot;
+  }
+
+  void publish_(Slot &slot, long result, bool last) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.result = result;
+      slot.last = last || result < 0;
+      slot.ready = true;
+    }
+    produced_.notify_all();
+  }
+
+  void decode_stream_(const char *input, size_t input_size) {
+    StreamDecoder decoder;
+    const bool opened = decoder.open(format_, input, input_size);
+    for (size_t ticket = 0;; ++ticket) {
+      auto slot = acquire_(ticket);
+      if (!slot)
+        return;
+      const auto result = opened ? decoder.fill(slot->memory.data() + carry_, chunk_size_) : -EINVAL;
+      publish_(*slot, result, result <= 0);
+      if (result <= 0)
+        return;
+    }
+  }
+
+#ifdef CSV2_WITH_ZSTD
+  void split_frames_(const char *input, size_t input_size) {
+    for (size_t offset = 0; offset < input_size;) {
+      const auto size = ZSTD_findFrameCompressedSize(input + offset, input_size - offset);
+      if (ZSTD_isError(size)) {
+        frames_.clear(); // let the stream decoder report the corruption
+        return;
+      }
+      // skippable frames (seek tables, metadata) carry no text
+      if (!is_zstd_skippable_frame(input + offset, size)) {
+        // a frame is decoded whole into its slot: only chunk-sized ones
+        const auto content_size = ZSTD_getFrameContentSize(input + offset, size);
+        if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR ||
+            content_size > parallel_frame_chunks_ * chunk_size_) {
+          frames_.clear();
+          return;
+        }
+        frames_.emplace_back(offset, size);
+      }
+      offset += size;
+    }
+  }
+
+  void decode_frames_(const char *input) {
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+    while (true) {
+      // one past the last frame publishes the end of input
+      const auto ticket = next_frame_.fetch_add(1);
+      if (ticket > frames_.size())
+        break;
+      auto slot = acquire_(ticket);
+      if (!slot)
+        break;
+      if (ticket == frames_.size()) {
+        slot->memory.resize(carry_ + 1);
+        publish_(*slot, 0, true);
+        break;
+      }
+      publish_(*slot, decode_frame_(context, input + frames_[ticket].first, frames_[ticket].second, slot->memory), false);
+    }
+    ZSTD_freeDCtx(context);
+  }
+
+  long decode_frame_(ZSTD_DCtx *context, const char *frame, size_t frame_size, std::vector<char> &memory) {
+    if (!context)
+      return -ENOMEM;
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+    // split_frames_ only keeps frames with a known, bounded content size
+    const auto expected = static_cast<size_t>(ZSTD_getFrameContentSize(frame, frame_size));
+    memory.resize(carry_ + expected + 1);
+    ZSTD_inBuffer in{frame, frame_size, 0};
+    ZSTD_outBuffer out{memory.data() + carry_, expected, 0};
+    while (true) {
+      const auto ret = ZSTD_decompressStream(context, &out, &in);
+      if (ZSTD_isError(ret))
+        return -EIO;
+      if (ret == 0)
+        break;
+      if (out.pos == out.size) {
+        // not done with the declared content in: grow, from at least a
+        // chunk so an empty buffer grows too, and give up on a frame
+        // producing far more than it declared
+        const auto size = std::max(out.size * 2, chunk_size_);
+        if (size > 2 * parallel_frame_chunks_ * chunk_size_)
+          return -EIO;
+        memory.resize(carry_ + size + 1);
+        out.dst = memory.data() + carry_;
+        out.size = size;
+      } else if (in.pos == in.size) {
+        return -EIO; // truncated
+      }
+    }
+    return static_cast<long>(out.pos);
+  }
+#endif
+};
+
+} // namespace detail
+
+// Reads plain, gzip and zstd compressed CSV alike, the format is detected
+// from the magic bytes. Decompression runs on background threads so parsing
+// overlaps with it; rows behave as in BlockReader.
+template <class delimiter = delimiter<','>, class quote_character = quote_character<'"'>,
+          class first_row_is_header = first_row_is_header<true>,
+          class trim_policy = trim_policy::trim_whitespace>
+using CompressedReader = BasicBlockReader<detail::DecompressRing, delimiter, quote_character,
+                                          first_row_is_header, trim_policy>;
+
+} // namespace csv2
@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <csv2/mio.hpp>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace csv2 {
+
+// What a sidecar (index, zone map, filter) records about the file it was
+// built from: size, modification time, inode and device, and a hash of the
+// first and last 4 KiB. A file regenerated in place to the same size changes
+// at least its modification time, so load() rejects the stale sidecar
+// instead of answering for the old contents. Buffers not backed by a file
+// only have the size and the hash.
+struct file_stamp {
+  uint64_t size{0};
+  uint64_t mtime_ns{0};
+  uint64_t inode{0};
+  uint64_t device{0};
+  uint64_t edges{0}; // FNV-1a of the first and last 4 KiB
+
+  bool operator==(const file_stamp &rhs) const {
+    return size == rhs.size && mtime_ns == rhs.mtime_ns && inode == rhs.inode &&
+           device == rhs.device && edges == rhs.edges;
+  }
+  bool operator!=(const file_stamp &rhs) const { return !(*this == rhs); }
+
+  // Of a buffer; `handle`, the open file behind it, adds its metadata
+  static file_stamp of(const char *data, size_t size,
+                       mio::file_handle_type handle = mio::invalid_handle) {
+    file_stamp stamp;
+    stamp.size = size;
+    const size_t edge = std::min<size_t>(size, 4096);
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&](const char *p, size_t n) {
+      for (size_t i = 0; i < n; ++i)
+        hash = (hash ^ static_cast<unsigned char>(p[i])) * 1099511628211ull;
+    };
+    if (data) {
+      mix(data, edge);
+      mix(data + size - edge, edge);
+    }
+    stamp.edges = hash;
+    if (handle == mio::invalid_handle)
+      return stamp;
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(handle, &info)) {
+      // 100 ns ticks
+      stamp.mtime_ns = ((uint64_t(info.ftLastWriteTime.dwHighDateTime) << 32) |
+                        info.ftLastWriteTime.dwLowDateTime) * 100;
+      stamp.inode = (uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+      stamp.device = info.dwVolumeSerialNumber;
+    }
+#else
+    struct stat st;
+    if (::fstat(handle, &st) == 0) {
+#ifdef __APPLE__
+      stamp.mtime_ns = uint64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+      stamp.mtime_ns = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+      stamp.inode = st.st_ino;
+      stamp.device = st.st_dev;
+    }
+#endif
+    return stamp;
+  }
+
+  // Of the file at `path`, mapped but only its first and last pages read;
+  // all zero if it cannot be mapped
+  static file_stamp of(const std::string &path) {
+    std::error_code error;
+    mio::mmap_source mapped;
+    mapped.map(path, error);
+    if (error)
+      return file_stamp();
+    return of(mapped.data(), mapped.mapped_length(), mapped.file_handle());
+  }
+
+  // Of the buffer of a Reader, and of its file when it was mmap'd
+  template <class ReaderT> static file_stamp of_reader(const ReaderT &reader) {
+    return of(reader.buffer(), reader.buffer_size(), reader.file_handle());
+  }
+};
+
+namespace detail {
+
+// a * b and a + b, false if they do not fit in 64 bits
+inline bool checked_mul(uint64_t a, uint64_t b, uint64_t &result) {
+  if (b != 0 && a > UINT64_MAX / b)
+    return false;
+  result = a * b;
+  return true;
+}
+
+inline bool checked_add(uint64_t a, uint64_t b, uint64_t &result) {
+  if (a > UINT64_MAX - b)
+    return false;
+  result = a + b;
+  return true;
+}
+
+// Sidecar files (zone maps, Bloom filters, hash indexes) start with the same
+// 56 bytes: an 8-byte magic, the format version, 4 bytes of zeros and the
+// stamp of the file they were built from. Values and arrays follow as they
+// are in memory.
+constexpr size_t sidecar_header_size = 56;
+
+class sidecar_writer {
+  std::ofstream out_;
+  uint64_t offset_{0};
+
+public:
+  sidecar_writer(const std::string &path, const char (&magic)[9], uint32_t version,
+                 const file_stamp &source)
+      : out_(path, std::ios::binary | std::ios::trunc) {
+    write(magic, 8);
+    write(version);
+    write(uint32_t(0));
+    write(source);
+  }
+
+  template <typename T> void write(const T &value) { write(&value, 1); }
+
+  template <typename T> void write(const T *values, uint64_t count) {
+    static_assert(std::is_trivially_copyable<T>::value, "written as it is in memory");
+    out_.write(reinterpret_cast<const char *>(values), count * sizeof(T));
+    offset_ += count * sizeof(T);
+  }
+
+  // Zeros up to `offset` from the start of the file
+  void pad(uint64_t offset) {
+    for (; offset_ < offset; ++offset_)
+      out_.put(0);
+  }
+
+  bool close() {
+    out_.close();
+    return static_cast<bool>(out_);
+  }
+};
+
+// Reads a sidecar written by sidecar_writer, memory-mapped. open() rejects a
+// file with another magic or version, and one whose stamp is not `source`,
+// the stamp of the file now: a sidecar left behind by a different version of
+// it. Every read checks what is left of the file first, so sizes taken from a
+// corrupt header never read or allocate past its end.
+class sidecar_reader {
+  mio::mmap_source mapped_;
+  uint64_t offset_{0};
+
+public:
+  bool open(const std::string &path, const char (&magic)[9], uint32_t version,
+            const file_stamp &source) {
+    std::error_code error;
+    mapped_.map(path, error);
+    offset_ = 0;
+    uint32_t stored_version{0}, zeros{1};
+    file_stamp stored;
+    return !error && remaining() >= sidecar_header_size && memcmp(mapped_.data(), magic, 8) == 0 &&
+           skip_to(8) && read(stored_version) && stored_version == version && read(zeros) &&
+           zeros == 0 && read(stored) && stored == source;
+  }
+
+  uint64_t remaining() const { return mapped_.size() - offset_; }
+  const char *data() const { return mapped_.data() + offset_; }
+
+  template <typename T> bool read(T &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "read as it is in memory");
+    if (remaining() < sizeof(T))
+      return false;
+    memcpy(&value, data(), sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T> bool read(std::vector<T> &values, uint64_t count) {
+    static_assert(std::is_trivially_copyable<T>::value, "read as it is in memory");
+    uint64_t bytes;
+    if (!checked_mul(count, sizeof(T), bytes) || remaining() < bytes)
+      return false;
+    values.resize(count);
+    if (bytes)
+      memcpy(values.data(), data(), bytes);
+    offset_ += bytes;
+    return true;
+  }
+
+  bool skip_to(uint64_t offset) {
+    if (offset < offset_ || offset > mapped_.size())
+      return false;
+    offset_ = offset;
+    return true;
+  }
+
+  // The mapping, for a sidecar used where it lies; data() stays valid
+  mio::mmap_source release() { return std::move(mapped_); }
+};
+
+// The data rows of a sidecar split into blocks of `block_rows_`
+class row_blocks {
+protected:
+  uint64_t rows_{0};
+  uint64_t block_rows_{0};
+
+  // Row ranges [first, last) of the blocks for which may_hold(block) is
+  // true, adjacent blocks merged
+  template <class F> std::vector<std::pair<size_t, size_t>> row_ranges_(F &&may_hold) const {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t block = 0; block < blocks(); ++block) {
+      if (!may_hold(block))
+        continue;
+      const auto span = block_span(block);
+      if (!ranges.empty() && ranges.back().second == span.first)
+        ranges.back().second = span.second;
+      else
+        ranges.push_back(span);
+    }
+    return ranges;
+  }
+
+public:
+  auto rows() const { return rows_; }
+  auto block_rows() const { return block_rows_; }
+  size_t blocks() const { return block_rows_ ? (rows_ + block_rows_ - 1) / block_rows_ : 0; }
+
+  // Rows [first, last) of a block
+  std::pair<size_t, size_t> block_span(size_t block) const {
+    return {block * block_rows_, std::min<size_t>((block + 1) * block_rows_, rows_)};
+  }
+};
+
+} // namespace detail
+
+} // namespace csv2
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace csv2 {
+
+// A test on the bytes of one cell, surrounding whitespace and quotes removed
+// (escaped quotes inside are compared as they are in the file). Nothing is
+// copied or converted except for numeric ranges, which parse the cell.
+class predicate {
+public:
+  enum class kind { equals, prefix, in_set, between, time_between };
+
+private:
+  kind kind_{kind::equals};
+  std::vector<std::string> values_;
+  std::unordered_set<std::string_view> set_; // views into values_
+  double low_{0}, high_{0};
+
+  predicate(kind k, std::vector<std::string> values) : kind_(k), values_(std::move(values)) {
+    for (const auto &v : values_)
+      set_.insert(v);
+  }
+
+public:
+  static predicate equals(std::string value) { return predicate(kind::equals, {std::move(value)}); }
+  static predicate prefix(std::string value) { return predicate(kind::prefix, {std::move(value)}); }
+  static predicate in_set(std::vector<std::string> values) {
+    return predicate(kind::in_set, std::move(values));
+  }
+  // low <= cell <= high; cells that are not numbers never match
+  static predicate between(double low, double high) {
+    predicate result(kind::between, {});
+    result.low_ = low;
+    result.high_ = high;
+    return result;
+  }
+  // Same for timestamps, in seconds since 1970 (see parse_timestamp)
+  static predicate time_between(double low, double high) {
+    auto result = between(low, high);
+    result.kind_ = kind::time_between;
+    return result;
+  }
+
+  // set_ points into values_, so copies rebuild it
+  predicate(const predicate &other) : predicate(other.kind_, other.values_) {
+    low_ = other.low_;
+    high_ = other.high_;
+  }
+  predicate &operator=(const predicate &other) { return *this = predicate(other); }
+  predicate(predicate &&) = default; // moving values_ keeps its elements in place
+  predicate &operator=(predicate &&) = default;
+
+  auto type() const { return kind_; }
+  // Values of equals, prefix and in_set
+  const std::vector<std::string> &values() const { return values_; }
+  // Bounds of between and time_between
+  auto low() const { return low_; }
+  auto high() const { return high_; }
+
+  bool operator()(std::string_view cell, char quote = '"') const {
+    cell = detail::strip_cell(cell, quote);
+    switch (kind_) {
+    case kind::equals:
+      return cell == values_.front();
+    case kind::prefix:
+      return cell.substr(0, values_.front().size()) == values_.front();
+    case kind::in_set:
+      return set_.count(cell) != 0;
+    case kind::between: {
+      double value;
+      return detail::parse_number(cell, value, quote) && low_ <= value && value <= high_;
+    }
+    case kind::time_between: {
+      double value;
+      return parse_timestamp(cell, value, quote) && low_ <= value && value <= high_;
+    }
+    }
+    return false;
+  }
+};
+
+namespace detail {
+
+// Call f(irow) for every data row in [first, last) whose cell `col`
+// satisfies `test`
+template <class ReaderT, class F>
+void for_each_match(const ReaderT &reader, size_t col, const predicate &test, size_t first,
+                    size_t last, F &&f) {
+  auto it = reader(first);
+  for (size_t irow = first; irow < last; ++irow, ++it)
+    if (test(cell_view(*it, col), reader.get_quote_ch()))
+      f(irow);
+}
+
+} // namespace detail
+
+// Rows whose cell `col` satisfies `test`, as a bitmap: bit i % 64 of word
+// i / 64 is set for data row i
+template <class ReaderT>
+std::vector<uint64_t> filter_bitmap(const ReaderT &reader, size_t col, const predicate &test) {
+  const size_t size = reader.size();
+  std::vector<uint64_t> result((size + 63) / 64);
+  detail::for_each_match(reader, col, test, 0, size,
+                         [&](size_t irow) { result[irow / 64] |= uint64_t(1) << (irow % 64); });
+  return result;
+}
+
+// Same, as the ascending list of matching data rows
+template <class ReaderT>
+std::vector<size_t> filter_rows(const ReaderT &reader, size_t col, const predicate &test) {
+  std::vector<size_t> result;
+  detail::for_each_match(reader, col, test, 0, reader.size(),
+                         [&](size_t irow) { result.push_back(irow); });
+  return result;
+}
+
+} // namespace csv2
@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <csv2/file_stamp.hpp>
+#include <csv2/mio.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace csv2 {
+
+// Maps the values of one column (cells without surrounding whitespace and
+// quotes) to the data rows holding them. An open-addressing table has a
+// 64-bit slot per distinct value, the first row holding it and a few bits of
+// its hash, and the other rows with the value are chained from there in row
+// order. A lookup touches a slot or two and compares the bytes of the
+// candidate rows' cells with the value. The key cells are hashed on several
+// threads. save() writes the table as it is in memory and load() maps it
+// back without reading it, for the file it was built from only (see
+// file_stamp).
+class HashIndex {
+  static constexpr uint32_t version_ = 2;
+  static constexpr size_t header_size_ = 128; // keeps the slots 8-byte aligned in the file
+  static_assert(detail::sidecar_header_size + 3 * sizeof(uint64_t) <= header_size_,
+                "the counts do not fit in the header");
+  static constexpr int row_bits_ = 40;
+  static constexpr uint64_t row_mask_ = (uint64_t(1) << row_bits_) - 1;
+
+  file_stamp source_;
+  uint64_t rows_{0};
+  uint64_t col_{0};
+  uint64_t mask_{0};                   // slots - 1, a power of two minus one
+  std::vector<uint64_t> owned_;        // slots and next rows of a built index
+  mio::mmap_source mapped_;            // or of a loaded one
+  const uint64_t *slots_{nullptr};     // row + 1 in the low bits (0: empty), hash above
+  const uint64_t *next_{nullptr};      // per row: next row + 1 with the same hash, or 0
+
+  // Call f(row) for the rows chained from the slots matching the hash, in
+  // row order, until it returns false
+  template <class F> void candidates_(uint64_t hash, F &&f) const {
+    if (!slots_)
+      return;
+    const uint64_t tag = hash >> row_bits_;
+    for (uint64_t i = hash & mask_;; i = (i + 1) & mask_) {
+      const auto slot = slots_[i];
+      if (slot == 0)
+        return;
+      if (slot >> row_bits_ != tag)
+        continue;
+      for (auto row = slot & row_mask_; row != 0; row = next_[row - 1])
+        if (!f(row - 1))
+          return;
+    }
+  }
+
+public:
+  static std::string sidecar_path(const std::string &filename, size_t col) {
+    return filename + ".csv2hash" + std::to_string(col);
+  }
+
+  HashIndex() = default;
+  HashIndex(const HashIndex &) = delete;
+  HashIndex &operator=(const HashIndex &) = delete;
+  HashIndex(HashIndex &&) = default;
+  HashIndex &operator=(HashIndex &&) = default;
+
+  // Indexes column `col` of the data rows indexed so far; `threads` 0 uses
+  // one per core
+  template <class ReaderT> bool build(const ReaderT &reader, size_t col, size_t threads = 0) {
+    *this = HashIndex();
+    if (col >= reader.cols() || reader.size() > row_mask_)
+      return false;
+    source_ = file_stamp::of_reader(reader);
+    rows_ = reader.size();
+    col_ = col;
+
+    // hash the key cells of contiguous row ranges in parallel
+    std::vector<uint64_t> hashes(rows_);
+    threads = std::min<size_t>(threads ? threads : std::max(1u, std::thread::hardware_concurrency()),
+                               std::max<size_t>(1, rows_ / 4096));
+    const auto hash_rows = [&](size_t first, size_t last) {
+      if (first == last)
+        return;
+      auto it = reader(first);
+      for (size_t irow = first; irow < last; ++irow, ++it)
+        hashes[irow] =
+            detail::hash_bytes(detail::strip_cell(cell_view(*it, col), reader.get_quote_ch()));
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t)
+      workers.emplace_back(hash_rows, rows_ * t / threads, rows_ * (t + 1) / threads);
+    hash_rows(0, rows_ / threads);
+    for (auto &worker : workers)
+      worker.join();
+
+    // at most half full; rows are appended to their value's chain in order
+    uint64_t slots = 16;
+    while (slots < rows_ * 2)
+      slots *= 2;
+    mask_ = slots - 1;
+    owned_.assign(slots + rows_, 0);
+    const auto table = owned_.data();
+    const auto next = table + slots;
+    std::vector<uint64_t> tails(slots); // last row of each slot's chain
+    for (uint64_t irow = 0; irow < rows_; ++irow) {
+      const auto hash = hashes[irow];
+      auto i = hash & mask_;
+      while (table[i] != 0 && hashes[(table[i] & row_mask_) - 1] != hash)
+        i = (i + 1) & mask_;
+      if (table[i] == 0)
+        table[i] = (hash >> row_bits_ << row_bits_) | (irow + 1);
+      else
+        next[tails[i]] = irow + 1;
+      tails[i] = irow;
+    }
+    slots_ = table;
+    next_ = next;
+    return true;
+  }
+
+  bool save(const std::string &path) const {
+    if (!slots_)
+      return false;
+    detail::sidecar_writer out(path, "CSV2HASH", version_, source_);
+    out.write(rows_);
+    out.write(col_);
+    out.write(mask_);
+    out.pad(header_size_);
+    out.write(slots_, mask_ + 1);
+    out.write(next_, rows_);
+    return out.close();
+  }
+
+  // Maps an index saved for the file stamped `source`
+  bool load(const std::string &path, const file_stamp &source) {
+    detail::sidecar_reader in;
+    HashIndex index;
+    uint64_t words, bytes;
+    // build() keeps at most 4 slots per row (16 at least), which also keeps
+    // the length below from overflowing on a corrupt header
+    if (!in.open(path, "CSV2HASH", version_, source) || !in.read(index.rows_) ||
+        !in.read(index.col_) || !in.read(index.mask_) || !in.skip_to(header_size_) ||
+        index.rows_ > row_mask_ || index.rows_ > source.size ||
+        (index.mask_ & (index.mask_ + 1)) != 0 || index.mask_ < index.rows_ ||
+        index.mask_ >= std::max<uint64_t>(16, index.rows_ * 4) ||
+        !detail::checked_add(index.mask_ + 1, index.rows_, words) ||
+        !detail::checked_mul(words, sizeof(uint64_t), bytes) || in.remaining() != bytes)
+      return false;
+    index.source_ = source;
+    index.slots_ = reinterpret_cast<const uint64_t *>(in.data());
+    index.next_ = index.slots_ + index.mask_ + 1;
+    index.mapped_ = in.release();
+    *this = std::move(index);
+    return true;
+  }
+
+  auto rows() const { return rows_; }
+  auto col() const { return col_; }
+
+  // Every data row whose cell equals `value`, in row order. An index built
+  // over a different number of rows than the reader now has is not used,
+  // the column is scanned instead.
+  template <class ReaderT>
+  std::vector<size_t> find_rows(const ReaderT &reader, std::string_view value) const {
+    std::vector<size_t> rows;
+    find_(reader, value, [&](size_t irow) {
+      rows.push_back(irow);
+      return true;
+    });
+    return rows;
+  }
+
+  // The first of them
+  template <class ReaderT>
+  std::optional<size_t> find_row(const ReaderT &reader, std::string_view value) const {
+    std::optional<size_t> row;
+    find_(reader, value, [&](size_t irow) {
+      row = irow;
+      return false;
+    });
+    return row;
+  }
+
+private:
+  template <class ReaderT, class F>
+  void find_(const ReaderT &reader, std::string_view value, F &&f) const {
+    const auto quote = reader.get_quote_ch();
+    const auto equal = [&](const auto &row) {
+      return detail::strip_cell(cell_view(row, col_), quote) == value;
+    };
+    if (!slots_ || rows_ != reader.size()) {
+      auto it = reader.begin();
+      for (size_t irow = 0; irow < reader.size(); ++irow, ++it)
+        if (equal(*it) && !f(irow))
+          return;
+      return;
+    }
+    candidates_(detail::hash_bytes(value),
+                [&](size_t irow) { return !equal(reader[irow]) || f(irow); });
+  }
+};
+
+} // namespace csv2
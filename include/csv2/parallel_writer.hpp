@@ -0,0 +1,220 @@
+#pragma once
+#include <condition_variable>
+#include <csv2/writer.hpp>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace csv2 {
+
+struct parallel_writer_options {
+  size_t threads{0};     // formatting threads, 0 = hardware concurrency
+  size_t queue_depth{0}; // batches submitted but not yet written, 0 = 2 x threads
+};
+
+// Formats batches of rows on a pool of worker threads and writes them to the
+// file in submission order. Each batch is a callable that receives a
+// Writer<delimiter, quote_character, memory_sink> to format its rows into;
+// batches complete out of order but a single committer thread writes them
+// back in sequence. submit() blocks once queue_depth batches are in flight.
+template <class delimiter, class quote_character> class ParallelWriter {
+public:
+  using BatchWriter = Writer<delimiter, quote_character, memory_sink>;
+  using Batch = std::function<void(BatchWriter &)>;
+
+private:
+  struct Slot {
+    std::string buffer; // kept between batches to reuse its capacity
+    bool ready{false};
+  };
+
+  int fd_{-1};
+  bool owns_fd_{false};
+  std::vector<std::thread> workers_;
+  std::thread committer_;
+  std::vector<Slot> slots_;                         // batch n formats into slots_[n % size]
+  std::deque<std::pair<size_t, Batch>> pending_;    // submitted, not yet picked up by a worker
+  size_t submitted_{0};                             // batches handed to submit()
+  size_t committed_{0};                             // batches written to the file
+  size_t bytes_written_{0};
+  bool stop_{false};
+  bool error_{false};
+  std::exception_ptr exception_;                    // first exception thrown by a batch
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;                 // workers: a batch is pending
+  std::condition_variable ready_cv_;                // committer: the next batch is formatted
+  std::condition_variable space_cv_;                // submit()/close(): a batch was written
+
+public:
+  ParallelWriter() = default;
+  ParallelWriter(const ParallelWriter &) = delete;
+  ParallelWriter &operator=(const ParallelWriter &) = delete;
+  ~ParallelWriter() { close_(); }
+
+  // Create/truncate `filename` and write to it
+  bool open(const std::string &filename, parallel_writer_options options = {}) {
+    close();
+    const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return false;
+    start_(fd, true, options);
+    return true;
+  }
+
+  // Write to an already open descriptor; it is not closed
+  bool open(int fd, parallel_writer_options options = {}) {
+    close();
+    if (fd < 0)
+      return false;
+    start_(fd, false, options);
+    return true;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  size_t threads() const { return workers_.size(); }
+
+  bool error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+  }
+
+  size_t bytes_written() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_written_;
+  }
+
+  // Queue a batch. Blocks while the queue is full; returns false when the
+  // writer is not open or once an earlier batch failed to format or write.
+  bool submit(Batch batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [&] {
+      return fd_ < 0 || error_ || submitted_ - committed_ < slots_.size();
+    });
+    if (error_ || fd_ < 0)
+      return false;
+    pending_.emplace_back(submitted_++, std::move(batch));
+    work_cv_.notify_one();
+    return true;
+  }
+
+  // Wait for every submitted batch to be written
+  bool flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [&] { return committed_ == submitted_; });
+    return !error_;
+  }
+
+  // Write the remaining batches and close the file. Rethrows the first
+  // exception thrown by a batch.
+  bool close() {
+    const auto ok = close_();
+    if (exception_)
+      std::rethrow_exception(std::exchange(exception_, nullptr));
+    return ok;
+  }
+
+private:
+  void start_(int fd, bool owns, parallel_writer_options options) {
+    fd_ = fd;
+    owns_fd_ = owns;
+    stop_ = error_ = false;
+    submitted_ = committed_ = bytes_written_ = 0;
+    const auto threads =
+        options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    slots_.resize(options.queue_depth ? options.queue_depth : 2 * threads);
+    for (size_t i = 0; i < threads; ++i)
+      workers_.emplace_back([this] { work_(); });
+    committer_ = std::thread([this] { commit_(); });
+  }
+
+  bool close_() {
+    if (fd_ < 0)
+      return !error_;
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    ready_cv_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+    committer_.join();
+    workers_.clear();
+    if (owns_fd_ && ::close(fd_) != 0)
+      error_ = true;
+    fd_ = -1;
+    return !error_;
+  }
+
+  void work_() {
+    BatchWriter writer;
+    for (;;) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&] { return stop_ || !pending_.empty(); });
+      if (pending_.empty())
+        return;
+      auto [sequence, batch] = std::move(pending_.front());
+      pending_.pop_front();
+      const auto skip = error_;
+      lock.unlock();
+
+      // the slot is ours until the committer has written this batch
+      auto &slot = slots_[sequence % slots_.size()];
+      std::exception_ptr exception;
+      if (!skip) {
+        try {
+          writer.open(slot.buffer);
+          batch(writer);
+          writer.close();
+        } catch (...) {
+          writer.close();
+          exception = std::current_exception();
+        }
+      }
+
+      lock.lock();
+      if (exception) {
+        error_ = true;
+        if (!exception_)
+          exception_ = exception;
+      }
+      slot.ready = true;
+      if (sequence == committed_)
+        ready_cv_.notify_one();
+    }
+  }
+
+  void commit_() {
+    for (;;) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_cv_.wait(lock, [&] {
+        return slots_[committed_ % slots_.size()].ready || (stop_ && committed_ == submitted_);
+      });
+      auto &slot = slots_[committed_ % slots_.size()];
+      if (!slot.ready)
+        return;
+      const auto skip = error_;
+      lock.unlock();
+
+      const auto ok = skip || detail::write_all(fd_, slot.buffer.data(), slot.buffer.size());
+
+      lock.lock();
+      if (!ok)
+        error_ = true;
+      else if (!skip)
+        bytes_written_ += slot.buffer.size();
+      slot.buffer.clear();
+      slot.ready = false;
+      committed_ += 1;
+      space_cv_.notify_all();
+    }
+  }
+};
+
+} // namespace csv2
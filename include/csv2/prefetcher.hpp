@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csv2/mio.hpp>
+#include <limits>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace csv2 {
+
+enum class prefetch_policy {
+  advise, // madvise(MADV_WILLNEED) the window and let the kernel read it in
+  touch   // advise, then fault every page of the window in from the prefetch thread
+};
+
+// Position of the consumer of a memory-mapped buffer, reported with
+// advance(). It is owned by the reader rather than by a Prefetcher, so
+// iterators can keep reporting to it while prefetching is switched on and
+// off; with no Prefetcher attached advance() is a relaxed store and a compare.
+struct PrefetchCursor {
+  std::atomic<size_t> position{0};
+  std::atomic<size_t> wake_at{std::numeric_limits<size_t>::max()}; // position that wakes the thread
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  void advance(size_t offset) {
+    position.store(offset, std::memory_order_relaxed);
+    if (offset >= wake_at.load(std::memory_order_relaxed))
+      cv.notify_one();
+  }
+};
+
+// Background read-ahead for a memory-mapped buffer. A helper thread keeps the
+// pages in [position, position + distance) resident, following the consumer
+// position in `cursor`, so parsing overlaps with I/O. The cursor has to
+// outlive the Prefetcher.
+class Prefetcher {
+  const char *buffer_{nullptr};     // start of the mapped buffer
+  size_t buffer_size_{0};           // length of the mapped buffer
+  size_t distance_{0};              // how far ahead of the consumer to stay
+  size_t chunk_{0};                 // bytes requested per madvise/touch step
+  prefetch_policy policy_;          // how pages are brought in
+  PrefetchCursor &cursor_;          // consumer position
+  std::atomic<size_t> prefetched_{0};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+
+public:
+  Prefetcher(const char *buffer, size_t buffer_size, size_t distance, PrefetchCursor &cursor,
+             prefetch_policy policy = prefetch_policy::touch)
+      : buffer_(buffer), buffer_size_(buffer_size),
+        distance_(std::max(distance, mio::page_size())), policy_(policy), cursor_(cursor) {
+    chunk_ = std::max(distance_ / 4, mio::page_size());
+    thread_ = std::thread([this] { run_(); });
+  }
+
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+
+  ~Prefetcher() { stop(); }
+
+  void advance(size_t offset) { cursor_.advance(offset); }
+
+  void stop() {
+    if (!thread_.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(cursor_.mutex);
+      stop_ = true;
+    }
+    cursor_.cv.notify_all();
+    thread_.join();
+    cursor_.wake_at.store(std::numeric_limits<size_t>::max(), std::memory_order_relaxed);
+  }
+
+  auto distance() const { return distance_; }
+  auto prefetched() const { return prefetched_.load(std::memory_order_relaxed); }
+
+private:
+  void run_() {
+    size_t done = 0;
+    while (!stop_) {
+      const auto target =
+          std::min(cursor_.position.load(std::memory_order_relaxed) + distance_, buffer_size_);
+      while (done < target && !stop_) {
+        const auto next = std::min(done + chunk_, target);
+        fetch_(done, next);
+        done = next;
+        prefetched_.store(done, std::memory_order_relaxed);
+      }
+      if (done >= buffer_size_) {
+        cursor_.wake_at.store(std::numeric_limits<size_t>::max(), std::memory_order_relaxed);
+        return;
+      }
+
+      // sleep until the consumer has eaten half of the window
+      const size_t wake_at = done > distance_ / 2 ? done - distance_ / 2 : 0;
+      cursor_.wake_at.store(wake_at, std::memory_order_relaxed);
+      std::unique_lock<std::mutex> lock(cursor_.mutex);
+      // advance() notifies without the lock, so bound the wait to cover a lost wakeup
+      cursor_.cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
+        return stop_ || cursor_.position.load(std::memory_order_relaxed) >= wake_at;
+      });
+    }
+  }
+
+  void fetch_(size_t start, size_t end) {
+    const auto page = mio::page_size();
+    const auto aligned = reinterpret_cast<uintptr_t>(buffer_ + start) & ~(uintptr_t(page) - 1);
+#ifndef _WIN32
+    ::madvise(reinterpret_cast<void *>(aligned),
+              reinterpret_cast<uintptr_t>(buffer_ + end) - aligned, MADV_WILLNEED);
+#endif
+    if (policy_ != prefetch_policy::touch)
+      return;
+    volatile char sink = 0;
+    for (auto p = reinterpret_cast<const char *>(aligned); p < buffer_ + end; p += page)
+      sink = *(p < buffer_ ? buffer_ : p);
+    (void)(sink);
+  }
+};
+
+} // namespace csv2
@@ -1,15 +1,27 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstring>
 #include <csv2/mio.hpp>
+#include <csv2/prefetcher.hpp>
 #include <istream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <set>
 #include <iterator>
 namespace csv2 {
 
+template <class, class, class, class, class> class BasicBlockReader;
+template <class, class, class, class> class SeekableReader;
+
 namespace trim_policy {
 struct no_trimming {
 public:
@@ -57,11 +69,17 @@ template <class delimiter = delimiter<','>, class quote_character = quote_charac
           class first_row_is_header = first_row_is_header<true>,
           class trim_policy = trim_policy::trim_whitespace>
 class Reader {
+  template <class, class, class, class, class> friend class BasicBlockReader;
+  template <class, class, class, class> friend class SeekableReader;
+
   mio::mmap_source mmap_;          // mmap source
+  std::shared_ptr<const void> owner_; // keeps a buffer handed to parse() alive
   const char *buffer_{nullptr};    // pointer to memory-mapped data
   size_t buffer_size_{0};          // mapped length of buffer
   size_t header_start_{0};         // start index of header (cache)
   size_t header_end_{0};           // end index of header (cache)
+  std::unique_ptr<PrefetchCursor> prefetch_cursor_; // created once, outlives the iterators reporting to it
+  std::unique_ptr<Prefetcher> prefetcher_; // optional read-ahead, stopped before mmap_ goes away
 
 public:
   using size_type = size_t;
@@ -70,35 +88,145 @@ public:
   Reader() {
   
   }
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  // Readers can be moved, also while mmap_async() indexes: the indexer, the
+  // prefetcher and the prefetch cursor live on the heap and only use the
+  // mapping, none of which moves. The moved-from reader is left empty.
+  Reader(Reader &&other) { *this = std::move(other); }
+  Reader &operator=(Reader &&other) {
+    if (this == &other)
+      return *this;
+    // our own threads read the buffer that is about to be replaced
+    indexer_.reset();
+    prefetcher_.reset();
+    mmap_ = std::move(other.mmap_);
+    owner_ = std::move(other.owner_);
+    buffer_ = std::exchange(other.buffer_, nullptr);
+    buffer_size_ = std::exchange(other.buffer_size_, 0);
+    header_start_ = std::exchange(other.header_start_, 0);
+    header_end_ = std::exchange(other.header_end_, 0);
+    prefetch_cursor_ = std::move(other.prefetch_cursor_);
+    prefetcher_ = std::move(other.prefetcher_);
+    headers_ = std::exchange(other.headers_, {});
+    row_index_ = std::exchange(other.row_index_, {});
+    row_cnt_ = std::exchange(other.row_cnt_, invalid_size_value);
+    col_cnt_ = std::exchange(other.col_cnt_, invalid_size_value);
+    indexer_ = std::move(other.indexer_);
+    return *this;
+  }
   
-  static auto get_delimiter() { return delimiter::value; }
-  static auto get_quote_ch() { return quote_character::value; }
+  static constexpr auto get_delimiter() { return delimiter::value; }
+  static constexpr auto get_quote_ch() { return quote_character::value; }
   // Use this if you'd like to mmap the CSV file
   template <typename StringType> bool mmap(StringType &&filename) {
+    if (!map_(std::forward<StringType>(filename)))
+      return false;
+    init_();
+    return true;
+  }
+
+  // Same, but returns once the header is parsed and counts and indexes the
+  // rows on a background thread. Until indexing_done(), rows(), size() and
+  // operator() cover the rows indexed so far, so the head of the file is
+  // usable right away; iterating from begin() always reaches the last row.
+  template <typename StringType> bool mmap_async(StringType &&filename) {
+    if (!map_(std::forward<StringType>(filename)))
+      return false;
+    init_async_();
+    return true;
+  }
+
+  bool indexing_done() const { return !indexing_(); }
+  size_t rows_indexed_so_far() const { return size(); }
+
+  // Fraction of the buffer scanned by the indexer, 1 once it is done
+  double indexing_progress() const {
+    if (!indexing_() || buffer_size_ == 0)
+      return 1.0;
+    return double(indexer_->bytes.load(std::memory_order_relaxed)) / buffer_size_;
+  }
+
+  // Block until the background indexing started by mmap_async() has finished
+  void wait_indexed() const {
+    if (!indexer_)
+      return;
+    std::unique_lock<std::mutex> lock(indexer_->mutex);
+    indexer_->done_cv.wait(lock, [&] { return indexer_->done.load(); });
+  }
+
+  // Start a background thread that keeps `distance` bytes ahead of the
+  // furthest RowIterator resident. Only iterators created afterwards report
+  // their position to it. Iterators report to a cursor owned by the reader,
+  // so prefetching can be switched off or restarted while they are in use.
+  bool enable_prefetch(size_t distance = 64 * 1024 * 1024,
+                       prefetch_policy policy = prefetch_policy::touch) {
+    prefetcher_.reset();
+    if (!mmap_.is_mapped() || buffer_size_ == 0)
+      return false;
+    if (!prefetch_cursor_)
+      prefetch_cursor_ = std::make_unique<PrefetchCursor>();
+    prefetcher_ = std::make_unique<Prefetcher>(buffer_, buffer_size_, distance, *prefetch_cursor_, policy);
+    return true;
+  }
+
+  void disable_prefetch() { prefetcher_.reset(); }
+  const Prefetcher *prefetcher() const { return prefetcher_.get(); }
+
+  // Use this if you have the CSV contents in memory already. The buffer is
+  // not copied and has to outlive the reader (and its rows)
+  bool parse(std::string_view contents) { return parse_(contents.data(), contents.size(), nullptr); }
+  bool parse(const char *contents) { return parse(std::string_view(contents)); }
+
+  // Same, but the reader takes ownership of the buffer
+  bool parse(std::string &&contents) {
+    auto owned = std::make_shared<std::string>(std::move(contents));
+    return parse_(owned->data(), owned->size(), owned);
+  }
+
+  bool parse(std::unique_ptr<char[]> contents, size_t size) {
+    std::shared_ptr<char[]> owned(std::move(contents));
+    return parse_(owned.get(), size, owned);
+  }
+
+private:
+  template <typename StringType> bool map_(StringType &&filename) {
+    indexer_.reset();
+    prefetcher_.reset();
+    if (prefetch_cursor_)
+      prefetch_cursor_->position = 0;
+    owner_.reset();
+    // a failed (or throwing) mapping leaves the reader empty, with nothing
+    // pointing into the previous buffer
+    mmap_.unmap();
+    buffer_ = nullptr;
+    buffer_size_ = 0;
+    headers_.clear();
+    row_index_.clear();
+    row_cnt_ = col_cnt_ = invalid_size_value;
     mmap_ = mio::mmap_source(filename);
     if (!mmap_.is_open() || !mmap_.is_mapped())
       return false;
     buffer_ = mmap_.data();
     buffer_size_ = mmap_.mapped_length();
-
-    init_header_();
-    row_cnt_ = init_rows_();
-    col_cnt_ = init_cols_();
-    for(auto& h : headers_)
-    {
-      h.col_cnt_ = col_cnt_;
-    }
     return true;
   }
 
-  // Use this if you have the CSV contents
-  // in an std::string already
-  template <typename StringType> bool parse(StringType &&contents) {
-    buffer_ = std::forward<StringType>(contents).c_str();
-    buffer_size_ = contents.size();
+  bool parse_(const char *contents, size_t size, std::shared_ptr<const void> owner) {
+    indexer_.reset();
+    prefetcher_.reset();
+    if (mmap_.is_mapped())
+      mmap_.unmap();
+    owner_ = std::move(owner);
+    buffer_ = contents;
+    buffer_size_ = size;
+    init_();
     return buffer_size_ > 0;
   }
 
+public:
   class RowIterator;
   class Row;
   class CellIterator;
@@ -124,6 +252,11 @@ public:
       return std::string_view(buffer_+start_, end_-start_);
     }
 
+    // Raw bytes of the cell, empty (rather than "NIL") for an empty cell
+    std::string_view raw_view() const {
+      return end_ > start_ ? std::string_view(buffer_ + start_, end_ - start_) : std::string_view();
+    }
+
     auto cell_no() const { return cell_no_; }
     // Returns the raw_value of the cell without handling escaped
     // content, e.g., cell containing """foo""" will be returned
@@ -284,6 +417,7 @@ public:
     size_t end_;
     int64_t line_no_;
     int32_t col_cnt_;
+    PrefetchCursor *prefetch_cursor_{nullptr};
 
   public:
     using value_type = Row;
@@ -299,8 +433,9 @@ public:
     auto find_next(size_t s) {
       s = std::min(s, buffer_size_);
       auto e = s;
-      if (const char *ptr =
-              static_cast<const char *>(memchr(buffer_+s, '\n', (buffer_size_ - s)))) {
+      if (const char *ptr = s < buffer_size_
+              ? static_cast<const char *>(memchr(buffer_+s, '\n', (buffer_size_ - s)))
+              : nullptr) {
         e = ptr - buffer_;
       } else {
         // last row
@@ -324,15 +459,19 @@ public:
     }
 
     RowIterator &operator++() {
-      start_ = end_ + 1;
+      // the last row may not end with '\n'
+      start_ = std::min(end_ + 1, buffer_size_);
       end_ = find_next(start_);
-      
+      if (prefetch_cursor_)
+        prefetch_cursor_->advance(start_);
+
       line_no_ = start_ > end_ ? line_no_ : (line_no_+1);
       return *this;
     }
 
     RowIterator &operator--() {
-      end_ = start_ - 1;
+      const bool unterminated = start_ == buffer_size_ && buffer_size_ > 0 && buffer_[buffer_size_ - 1] != '\n';
+      end_ = unterminated ? buffer_size_ : start_ - 1;
       start_ = find_prev(end_);
       line_no_ = 0 >= line_no_ ? 0 : (line_no_-1);
       return *this;
@@ -370,8 +509,8 @@ public:
       return result;
     }
 
-    bool operator!=(const RowIterator &rhs) { return start_ != rhs.start_; }
-    bool operator==(const RowIterator &rhs) { return start_ == rhs.start_; }
+    bool operator!=(const RowIterator &rhs) const { return start_ != rhs.start_; }
+    bool operator==(const RowIterator &rhs) const { return start_ == rhs.start_; }
   };
   using value_type = Row;
   using reference = Row;
@@ -400,12 +539,11 @@ public:
   RowIterator begin() const {
     if (buffer_size_ == 0)
       return end();
-    if (first_row_is_header::value) {
-      const auto header_indices = header_indices_();
-      return RowIterator(buffer_, buffer_size_, header_indices.second  > 0 ? header_indices.second + 1 : 0, 0, col_cnt_);
-    } else {
-      return RowIterator(buffer_, buffer_size_, 0, 0, col_cnt_);
-    }
+    RowIterator it = first_row_is_header::value
+        ? RowIterator(buffer_, buffer_size_, header_indices_().second > 0 ? std::min(header_indices_().second + 1, buffer_size_) : 0, 0, col_cnt_)
+        : RowIterator(buffer_, buffer_size_, 0, 0, col_cnt_);
+    it.prefetch_cursor_ = prefetcher_ ? prefetch_cursor_.get() : nullptr;
+    return it;
   }
 
   RowIterator end() const { return RowIterator(buffer_, buffer_size_, buffer_size_, size(), col_cnt_); }
@@ -413,23 +551,69 @@ public:
   RRowIterator rbegin() const { return --end(); }
   RRowIterator rend() const { return --begin(); }
   
-  RowIterator operator() (size_t irow) {
-    if(irow < size()/2) {
-      RowIterator it = begin();
-      it += irow;
-      return it;
-    }
-    else {
-      RowIterator it = end();
-      irow = std::min(irow, size());
-      it -= size()-irow;
+  // Iterator at data row irow (clamped to end()): jumps to the closest
+  // indexed line and walks fewer than row_index_stride rows from there.
+  // end() as well on a reader that holds no buffer.
+  RowIterator operator() (size_t irow) const {
+    if (irow >= size())
+      return end();
+    std::unique_lock<std::mutex> lock;
+    if (indexing_())
+      lock = std::unique_lock<std::mutex>(indexer_->mutex);
+    const auto &index = row_index_of_();
+    if (index.empty())
+      return end();
+    const size_t line = headers_.size() + irow;
+    const size_t k = std::min(line / row_index_stride, index.size() - 1);
+    const size_t walk = line - k * row_index_stride;
+    RowIterator it(buffer_, buffer_size_, index[k], int64_t(irow) - int64_t(walk), col_cnt_);
+    if (lock)
+      lock.unlock();
+    it.prefetch_cursor_ = prefetcher_ ? prefetch_cursor_.get() : nullptr;
+    it += walk;
+    return it;
+  }
 
-      return it;
+  Row operator[] (size_t irow) const { return *(*this)(irow); }
+
+  // Data row and cell holding byte `offset` of the buffer, found through the
+  // row index. A delimiter belongs to the cell before it; offsets in the
+  // header give row 0.
+  std::pair<size_t, size_t> locate(size_t offset) const {
+    offset = std::min(offset, buffer_size_);
+    size_t start, line;
+    {
+      std::unique_lock<std::mutex> lock;
+      if (indexing_())
+        lock = std::unique_lock<std::mutex>(indexer_->mutex);
+      const auto &index = row_index_of_();
+      if (index.empty())
+        return {0, 0};
+      const auto k = std::upper_bound(index.begin(), index.end(), offset) - index.begin() - 1;
+      start = index[k];
+      line = k * row_index_stride;
+    }
+    for (const char *p; (p = static_cast<const char *>(memchr(buffer_ + start, '\n', offset - start)));) {
+      start = p - buffer_ + 1;
+      ++line;
     }
+    if (line < headers_.size())
+      return {0, 0};
+
+    Row row;
+    row.buffer_ = buffer_;
+    row.start_ = start;
+    row.end_ = RowIterator(buffer_, buffer_size_, start, 0, col_cnt_).end_;
+    row.col_cnt_ = col_cnt_;
+    auto cell = row.begin();
+    while (cell.cur_end_ < offset && cell.cur_end_ < row.end_)
+      ++cell;
+    return {line - headers_.size(), size_t(cell.cell_no())};
   }
-
-  Row operator[] (size_t irow) { return *(*this)(irow); }
   auto buffer() const { return buffer_; }
+  auto buffer_size() const { return buffer_size_; }
+  // descriptor of the mmap'd file, or an invalid handle for parse()d buffers
+  auto file_handle() const { return mmap_.is_mapped() ? mmap_.file_handle() : mio::invalid_handle; }
 
 private:
   std::pair<size_t, size_t> header_indices_() const {
@@ -439,10 +623,78 @@ private:
 
 public:
   const auto& header() const { return headers_; }
-  auto rows() const { return row_cnt_; }
+  size_t rows() const {
+    return indexer_ ? indexer_->rows.load(std::memory_order_acquire) : row_cnt_;
+  }
   auto cols() const { return col_cnt_; }
-  auto size() const { return row_cnt_-headers_.size(); }
+  auto size() const { return rows()-headers_.size(); }
 private:
+  // Background row counting started by mmap_async(). The thread only uses
+  // this block and the buffer, so the reader can move while it runs.
+  struct Indexer {
+    std::thread thread;
+    std::mutex mutex;                 // guards index while it grows
+    std::condition_variable done_cv;
+    std::vector<size_t> index;        // row_index_ of the buffer being indexed
+    std::atomic<size_t> rows{0};      // complete lines counted so far, all of them once done
+    std::atomic<size_t> bytes{0};     // bytes scanned so far
+    std::atomic<bool> done{false};
+    std::atomic<bool> stop{false};    // the reader is being reset, give up
+
+    ~Indexer() {
+      stop = true;
+      if (thread.joinable())
+        thread.join();
+    }
+  };
+
+  // bytes scanned between two publications of the background index
+  static constexpr size_t indexing_slice = 8 * 1024 * 1024;
+
+  bool indexing_() const { return indexer_ && !indexer_->done.load(std::memory_order_acquire); }
+
+  // the row index of the current buffer; lock the indexer's mutex while indexing_()
+  const std::vector<size_t> &row_index_of_() const { return indexer_ ? indexer_->index : row_index_; }
+
+  // header, row and column counts for the current buffer_
+  void init_() {
+    headers_.clear();
+    init_header_();
+    row_cnt_ = init_rows_(buffer_, buffer_size_, headers_.size(), row_index_);
+    col_cnt_ = init_cols_();
+    for(auto& h : headers_)
+    {
+      h.col_cnt_ = col_cnt_;
+    }
+  }
+
+  // header and column count now, rows on a background thread
+  void init_async_() {
+    headers_.clear();
+    init_header_();
+    col_cnt_ = init_cols_();
+    for(auto& h : headers_)
+    {
+      h.col_cnt_ = col_cnt_;
+    }
+    row_index_.clear();
+
+    indexer_ = std::make_unique<Indexer>();
+    indexer_->rows = headers_.size();
+    if (buffer_size_ > 0)
+      indexer_->index.push_back(0);
+    indexer_->thread = std::thread([indexer = indexer_.get(), buffer = buffer_, size = buffer_size_,
+                                    headers = headers_.size()] {
+      const auto rows = init_rows_(buffer, size, headers, indexer->index, indexer);
+      {
+        std::lock_guard<std::mutex> lock(indexer->mutex);
+        indexer->rows.store(rows, std::memory_order_release);
+        indexer->done.store(true, std::memory_order_release);
+      }
+      indexer->done_cv.notify_all();
+    });
+  }
+
   void init_header_() {
     if (!first_row_is_header::value) return;
 
@@ -456,9 +708,12 @@ private:
       result.start_ = start;
       result.end_ = end;
 
-      if (const char *ptr =
-              static_cast<const char *>(memchr(&buffer_[start], '\n', (buffer_size_ - start)))) {
-        end = start + (ptr - &buffer_[start]);
+      const char *ptr = start < buffer_size_
+          ? static_cast<const char *>(memchr(&buffer_[start], '\n', (buffer_size_ - start)))
+          : nullptr;
+      // an unterminated last line is a row as well
+      if (ptr || start < buffer_size_) {
+        end = ptr ? start + (ptr - &buffer_[start]) : buffer_size_;
         result.end_ = end;
         
         auto first_cell = *result.begin();
@@ -473,7 +728,7 @@ private:
           header_names.insert(preffix);
           start = end+1;
           end = start;
-          continue_next = true;
+          continue_next = ptr != nullptr;
         }
       }
       else {
@@ -483,18 +738,60 @@ private:
     } while (continue_next);
   }
 
-  size_t init_rows_() {
+  // Count the lines of `buffer` and record every row_index_stride-th line
+  // start in `row_index`. With an indexer (`row_index` already holds line 0
+  // and is guarded by its mutex) the buffer is scanned in slices, each
+  // slice's index entries and line count being published before the next
+  // one. Static, as the indexer thread must not reach into the reader.
+  static size_t init_rows_(const char *buffer, size_t size, size_t headers,
+                           std::vector<size_t> &row_index, Indexer *indexer = nullptr) {
     size_t result{0};
-    if (!buffer_ || buffer_size_ == 0)
+    if (!indexer)
+      row_index.clear();
+    if (!buffer || size == 0)
       return result;
-    for (const char *p = buffer_; (p = (char *)memchr(p, '\n', (buffer_ + buffer_size_) - p)); ++p)
+    if (!indexer)
+      row_index.push_back(0);
+
+    std::vector<size_t> found; // entries of the current slice, with an indexer
+    auto &index = indexer ? found : row_index;
+    const char *last = buffer + size - 1;
+    const size_t slice = indexer ? indexing_slice : size;
+    for (size_t from = 0; from < size;) {
+      const size_t to = from + std::min(slice, size - from);
+      for (const char *p = buffer + from; (p = (char *)memchr(p, '\n', (buffer + to) - p)); ++p) {
+        ++result;
+        if (result % row_index_stride == 0 && p != last)
+          index.push_back(p + 1 - buffer);
+      }
+      from = to;
+      if (indexer) {
+        std::lock_guard<std::mutex> lock(indexer->mutex);
+        row_index.insert(row_index.end(), found.begin(), found.end());
+        found.clear();
+        indexer->rows.store(std::max(result, headers), std::memory_order_release);
+        indexer->bytes.store(to, std::memory_order_relaxed);
+        if (indexer->stop)
+          return result;
+      }
+    }
+    // last row without a trailing newline
+    if (buffer[size - 1] != '\n')
       ++result;
     return result;
   }
 
   size_t init_cols_() {
     size_t result{0};
-    for(auto& row : headers_) {
+    std::vector<Row> rows = headers_;
+    // without a header the first row sets the shape
+    if (rows.empty() && buffer_size_ > 0) {
+      Row first;
+      first.buffer_ = buffer_;
+      first.end_ = RowIterator(buffer_, buffer_size_, 0, 0, 0).end_;
+      rows.push_back(first);
+    }
+    for(auto& row : rows) {
       size_t cols{0};
       for(auto itCol = row.begin(); itCol.cur_start_ != row.end_; ++itCol) {
         cols += 1;
@@ -505,11 +802,17 @@ private:
     return result;
   }
 
+public:
+  // one line start in every row_index_stride lines is kept in row_index_
+  static constexpr size_t row_index_stride = 16;
+
 private:
   std::vector<Row> headers_;
+  std::vector<size_t> row_index_;  // start of lines 0, stride, 2 * stride, ... (indexer_->index after mmap_async())
   static constexpr size_t invalid_size_value = std::numeric_limits<size_t>::max();
   size_t row_cnt_{invalid_size_value};
   size_t col_cnt_{invalid_size_value};
+  std::unique_ptr<Indexer> indexer_; // last member: stopped before the buffer and index go away
 };
 
 using CommaHeaderCSV = csv2::Reader<csv2::delimiter<','>, 
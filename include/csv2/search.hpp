@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <csv2/reader.hpp>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace csv2 {
+
+struct search_hit {
+  size_t row;    // data row
+  size_t col;    // cell of the row
+  size_t offset; // first byte of the match in the reader's buffer
+  size_t length;
+};
+
+enum class search_direction { forward, backward };
+
+namespace detail {
+
+// A match as a pointer into the buffer (null if none) and its length
+using match = std::pair<const char *, size_t>;
+
+// Plain substring search, on glibc's vectorized memmem
+class substring_matcher {
+  std::string pattern_;
+  static constexpr size_t window = 1024 * 1024; // backward scan step
+
+public:
+  explicit substring_matcher(std::string pattern) : pattern_(std::move(pattern)) {}
+
+  // First match in [begin, end)
+  match first(const char *begin, const char *end, bool = false) const {
+    if (pattern_.empty())
+      return {nullptr, 0};
+    const auto p = memmem(begin, end - begin, pattern_.data(), pattern_.size());
+    return {static_cast<const char *>(p), pattern_.size()};
+  }
+
+  // Last match in [begin, end): windows scanned from the end, overlapping by
+  // the pattern length so no match is cut
+  match last(const char *begin, const char *end) const {
+    if (pattern_.empty() || size_t(end - begin) < pattern_.size())
+      return {nullptr, 0};
+    const auto step = std::max(window, 2 * pattern_.size());
+    for (auto hi = end;;) {
+      const auto lo = size_t(hi - begin) > step ? hi - step : begin;
+      match found{nullptr, 0};
+      for (auto m = first(lo, hi); m.first; m = first(m.first + 1, hi))
+        found = m;
+      if (found.first || lo == begin)
+        return found;
+      hi = lo + pattern_.size() - 1;
+    }
+  }
+};
+
+// Longest run of plain characters that every match of an ECMAScript pattern
+// contains, or "" when that is not obvious (alternation, escapes such as \d,
+// quantified characters and anything inside groups or brackets are skipped)
+inline std::string required_literal(const std::string &pattern) {
+  if (pattern.find('|') != std::string::npos)
+    return {};
+  std::string best, run;
+  const auto flush = [&] {
+    if (run.size() > best.size())
+      best = run;
+    run.clear();
+  };
+  const auto any_of = [](char c, const char *set) { return c != '\0' && strchr(set, c); };
+  const auto quantified = [&](size_t i) { return i + 1 < pattern.size() && any_of(pattern[i + 1], "*?{"); };
+  int depth = 0;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    const char c = pattern[i];
+    if (c == '\\' && i + 1 < pattern.size() && !isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+      ++i; // escaped punctuation is itself
+      if (depth == 0 && !quantified(i))
+        run.push_back(pattern[i]);
+      else
+        flush();
+    } else if (c == '[') {
+      flush();
+      // a ']' right after '[' or '[^' is part of the set
+      i += pattern.compare(i, 2, "[^") == 0 ? 2 : 1;
+      if (i < pattern.size() && pattern[i] == ']')
+        ++i;
+      while (i < pattern.size() && pattern[i] != ']')
+        i += pattern[i] == '\\' ? 2 : 1;
+    } else if (c == '(' || c == ')') {
+      flush();
+      depth += c == '(' ? 1 : -1;
+    } else if (c == '{') {
+      flush();
+      while (i < pattern.size() && pattern[i] != '}')
+        ++i;
+    } else if (any_of(c, "\\.*+?^$") || depth != 0 || quantified(i)) {
+      flush();
+      if (c == '\\')
+        ++i; // character class escape such as \d
+    } else {
+      run.push_back(c);
+    }
+  }
+  flush();
+  return best;
+}
+
+// ECMAScript regular expression, matched line by line so ^ and $ anchor at
+// row boundaries. When the pattern requires a literal, memmem finds the
+// candidate lines and only those go through the (much slower) regex engine.
+class regex_matcher {
+  std::regex regex_;
+  std::string literal_;
+
+  const char *line_start_(const char *begin, const char *p) const {
+    const auto nl = static_cast<const char *>(memrchr(begin, '\n', p - begin));
+    return nl ? nl + 1 : begin;
+  }
+
+  const char *line_end_(const char *p, const char *end) const {
+    const auto nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    return nl ? nl : end;
+  }
+
+  match search_line_(const char *line, const char *eol, bool resume) const {
+    std::cmatch m;
+    const auto flags = resume ? std::regex_constants::match_prev_avail
+                              : std::regex_constants::match_default;
+    if (std::regex_search(line, eol, m, regex_, flags))
+      return {m[0].first, size_t(m.length(0))};
+    return {nullptr, 0};
+  }
+
+  match last_in_line_(const char *line, const char *eol) const {
+    match found{nullptr, 0};
+    for (std::cregex_iterator it(line, eol, regex_), done; it != done; ++it)
+      found = {(*it)[0].first, size_t(it->length(0))};
+    return found;
+  }
+
+public:
+  explicit regex_matcher(const std::string &pattern)
+      : regex_(pattern, std::regex::optimize), literal_(required_literal(pattern)) {
+    if (literal_.size() < 2)
+      literal_.clear();
+  }
+
+  // First match in [begin, end); `resume` when begin is inside a line (right
+  // after a previous match) rather than at its start
+  match first(const char *begin, const char *end, bool resume = false) const {
+    for (auto line = begin; line < end;) {
+      if (!literal_.empty()) {
+        const auto p = static_cast<const char *>(
+            memmem(line, end - line, literal_.data(), literal_.size()));
+        if (!p)
+          break;
+        line = line_start_(line, p);
+      }
+      const auto eol = line_end_(line, end);
+      const auto found = search_line_(line, eol, resume && line == begin);
+      if (found.first)
+        return found;
+      line = eol + 1;
+    }
+    return {nullptr, 0};
+  }
+
+  // Last match in [begin, end)
+  match last(const char *begin, const char *end) const {
+    const substring_matcher literal(literal_);
+    for (auto eol = end; eol > begin;) {
+      if (!literal_.empty()) {
+        const auto m = literal.last(begin, eol);
+        if (!m.first)
+          break;
+        eol = line_end_(m.first, eol);
+      }
+      const auto line = line_start_(begin, eol);
+      const auto found = last_in_line_(line, eol);
+      if (found.first)
+        return found;
+      if (line == begin)
+        break;
+      eol = line - 1;
+    }
+    return {nullptr, 0};
+  }
+};
+
+// Bytes of data rows [first, last], without the final newline
+template <class ReaderT>
+std::pair<const char *, const char *> row_span(const ReaderT &reader, size_t first, size_t last) {
+  const auto end = reader[last].as_string();
+  return {reader[first].as_string().data(), end.data() + end.size()};
+}
+
+template <class ReaderT, class Matcher>
+std::optional<search_hit> find_with(const ReaderT &reader, const Matcher &matcher,
+                                    size_t from_row, search_direction direction) {
+  const size_t size = reader.size();
+  if (size == 0 || (direction == search_direction::forward && from_row >= size))
+    return {};
+  const auto [begin, end] = direction == search_direction::forward
+                                ? row_span(reader, from_row, size - 1)
+                                : row_span(reader, 0, std::min(from_row, size - 1));
+  const auto [pos, length] = direction == search_direction::forward ? matcher.first(begin, end)
+                                                                    : matcher.last(begin, end);
+  if (!pos)
+    return {};
+  const size_t offset = pos - reader.buffer();
+  const auto [row, col] = reader.locate(offset);
+  return search_hit{row, col, offset, length};
+}
+
+} // namespace detail
+
+// First match of `pattern` in data rows from_row, from_row + 1, ... or, going
+// backward, the last one in rows from_row, from_row - 1, ... 0. Rows not
+// indexed yet (Reader::mmap_async) are not searched.
+template <class ReaderT>
+std::optional<search_hit> find(const ReaderT &reader, std::string_view pattern, size_t from_row = 0,
+                               search_direction direction = search_direction::forward) {
+  return detail::find_with(reader, detail::substring_matcher(std::string(pattern)), from_row,
+                           direction);
+}
+
+// Same with an ECMAScript regular expression matched within each row;
+// throws std::regex_error for an invalid pattern
+template <class ReaderT>
+std::optional<search_hit> find_regex(const ReaderT &reader, const std::string &pattern,
+                                     size_t from_row = 0,
+                                     search_direction direction = search_direction::forward) {
+  return detail::find_with(reader, detail::regex_matcher(pattern), from_row, direction);
+}
+
+// Collects every match of a pattern on a background thread. The data rows
+// are scanned front to back in slices of whole lines, so hits are in row
+// order and hits_so_far() grows while the scan runs; next() answers "search
+// next/previous" from what has been found so far.
+template <class ReaderT> class Searcher {
+  const ReaderT *reader_{nullptr};
+  std::function<detail::match(const char *, const char *, bool)> first_;
+  std::vector<search_hit> hits_;
+  size_t scanned_{0};             // bytes of the data rows scanned so far
+  size_t total_{0};               // bytes of the data rows
+  bool done_{true};
+  std::atomic<bool> stop_{false};
+  mutable std::mutex mutex_;
+  mutable std::condition_variable done_cv_;
+  std::thread thread_;
+
+  static constexpr size_t slice = 4 * 1024 * 1024; // bytes scanned between publications
+
+public:
+  Searcher() = default;
+  Searcher(const Searcher &) = delete;
+  Searcher &operator=(const Searcher &) = delete;
+  ~Searcher() { cancel(); }
+
+  // Start searching `reader`, which has to outlive the search, for a
+  // substring or (with regex) an ECMAScript regular expression. Throws
+  // std::regex_error for an invalid pattern.
+  bool start(const ReaderT &reader, const std::string &pattern, bool regex = false) {
+    cancel();
+    if (regex) {
+      auto matcher = std::make_shared<detail::regex_matcher>(pattern);
+      first_ = [matcher](const char *b, const char *e, bool r) { return matcher->first(b, e, r); };
+    } else {
+      auto matcher = std::make_shared<detail::substring_matcher>(pattern);
+      first_ = [matcher](const char *b, const char *e, bool r) { return matcher->first(b, e, r); };
+    }
+    reader_ = &reader;
+    hits_.clear();
+    scanned_ = total_ = 0;
+    done_ = false;
+    stop_ = false;
+    thread_ = std::thread([this] { scan_(); });
+    return true;
+  }
+
+  // Stop the scan; the hits found so far are kept
+  void cancel() {
+    stop_ = true;
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  bool done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+  }
+
+  void wait() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] { return done_; });
+  }
+
+  // Fraction of the data rows scanned
+  double progress() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_ ? 1.0 : total_ ? double(scanned_) / total_ : 0.0;
+  }
+
+  size_t hits_so_far() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_.size();
+  }
+
+  std::vector<search_hit> hits(size_t from = 0) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    from = std::min(from, hits_.size());
+    return std::vector<search_hit>(hits_.begin() + from, hits_.end());
+  }
+
+  // First hit in row from_row or after it (forward), or last one in from_row
+  // or before it (backward), among the hits found so far
+  std::optional<search_hit> next(size_t from_row,
+                                 search_direction direction = search_direction::forward) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (direction == search_direction::forward) {
+      const auto it = std::lower_bound(hits_.begin(), hits_.end(), from_row,
+                                       [](const search_hit &h, size_t row) { return h.row < row; });
+      if (it != hits_.end())
+        return *it;
+    } else {
+      const auto it = std::upper_bound(hits_.begin(), hits_.end(), from_row,
+                                       [](size_t row, const search_hit &h) { return row < h.row; });
+      if (it != hits_.begin())
+        return *(it - 1);
+    }
+    return {};
+  }
+
+private:
+  void scan_() {
+    reader_->wait_indexed();
+    const auto buffer = reader_->buffer();
+    const size_t size = reader_->size();
+    const auto [begin, end] =
+        size ? detail::row_span(*reader_, 0, size - 1) : std::pair<const char *, const char *>{};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      total_ = end - begin;
+    }
+
+    std::vector<search_hit> found;
+    for (auto from = begin; from < end && !stop_;) {
+      // extend the slice to the end of its last line
+      auto to = from + std::min(slice, size_t(end - from));
+      const auto nl = static_cast<const char *>(memchr(to - 1, '\n', end - to + 1));
+      to = nl ? nl + 1 : end;
+
+      for (auto m = first_(from, to, false); m.first;) {
+        const size_t offset = m.first - buffer;
+        const auto [row, col] = reader_->locate(offset);
+        found.push_back(search_hit{row, col, offset, m.second});
+        const auto next = m.first + std::max<size_t>(m.second, 1);
+        if (next >= to)
+          break;
+        m = first_(next, to, next[-1] != '\n');
+      }
+      from = to;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      hits_.insert(hits_.end(), found.begin(), found.end());
+      scanned_ = from - begin;
+      found.clear();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    done_cv_.notify_all();
+  }
+};
+
+} // namespace csv2
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace csv2 {
+
+// How the cells of a sorted column compare: as numbers, as timestamps (see
+// parse_timestamp) or byte by byte, without surrounding whitespace and quotes
+enum class key_order { number, timestamp, text };
+
+namespace detail {
+
+class sort_key {
+  key_order order_;
+  double number_{0};
+  std::string text_;
+
+public:
+  // a number compared to text cells compares as a number
+  sort_key(double key, key_order order)
+      : order_(order == key_order::text ? key_order::number : order), number_(key) {}
+
+  sort_key(std::string_view key, key_order order) : order_(order), text_(key) {
+    if ((order == key_order::number && !parse_number(key, number_)) ||
+        (order == key_order::timestamp && !parse_timestamp(key, number_)))
+      throw std::invalid_argument("sort key is not a " +
+                                  std::string(order == key_order::number ? "number" : "timestamp") +
+                                  ": " + text_);
+  }
+
+  // Sign of cell - key in `result`; false for cells that are empty or do not
+  // parse, which the searches step over
+  bool compare(std::string_view cell, char quote, int &result) const {
+    cell = strip_cell(cell, quote);
+    if (cell.empty())
+      return false;
+    if (order_ == key_order::text) {
+      const auto c = cell.compare(text_);
+      result = (c > 0) - (c < 0);
+      return true;
+    }
+    double value;
+    if (!(order_ == key_order::number ? parse_number(cell, value, quote)
+                                      : parse_timestamp(cell, value, quote)) ||
+        value != value)
+      return false;
+    result = (value > number_) - (value < number_);
+    return true;
+  }
+};
+
+// For a column sorted ascending on `key`'s order: the first data row whose
+// cell compares above the key (upper) or not below it (lower). Each probe
+// looks the row up through the row index and parses that one cell; a probe
+// landing on cells without a value walks forward to the next one. Rows
+// without a value at the result are skipped as well, so a row returned
+// before size() always holds a value.
+template <class ReaderT>
+size_t partition_rows(const ReaderT &reader, size_t col, const sort_key &key, bool upper) {
+  const auto quote = reader.get_quote_ch();
+  const size_t size = reader.size();
+  size_t first = 0, last = size;
+  int c = 0;
+  while (first < last) {
+    const size_t mid = first + (last - first) / 2;
+    size_t probe = mid;
+    for (auto it = reader(mid); probe < last && !key.compare(cell_view(*it, col), quote, c); ++it)
+      ++probe;
+    if (probe < last && (upper ? c <= 0 : c < 0))
+      first = probe + 1;
+    else
+      last = mid;
+  }
+  if (first < size)
+    for (auto it = reader(first); first < size && !key.compare(cell_view(*it, col), quote, c); ++it)
+      ++first;
+  return first;
+}
+
+} // namespace detail
+
+// Binary searches over a column sorted ascending, as std::lower_bound,
+// std::upper_bound and std::equal_range over the data rows: O(log n) cells
+// are parsed instead of scanning the file. Cells without a value are stepped
+// over; a string key is parsed according to `order` and throws
+// std::invalid_argument if it is not a number or a timestamp when one is
+// expected. Rows between two timestamps are
+// [lower_bound(from), upper_bound(to)).
+template <class ReaderT>
+size_t lower_bound(const ReaderT &reader, size_t col, double key,
+                   key_order order = key_order::number) {
+  return detail::partition_rows(reader, col, detail::sort_key(key, order), false);
+}
+
+template <class ReaderT>
+size_t lower_bound(const ReaderT &reader, size_t col, std::string_view key,
+                   key_order order = key_order::text) {
+  return detail::partition_rows(reader, col, detail::sort_key(key, order), false);
+}
+
+template <class ReaderT>
+size_t upper_bound(const ReaderT &reader, size_t col, double key,
+                   key_order order = key_order::number) {
+  return detail::partition_rows(reader, col, detail::sort_key(key, order), true);
+}
+
+template <class ReaderT>
+size_t upper_bound(const ReaderT &reader, size_t col, std::string_view key,
+                   key_order order = key_order::text) {
+  return detail::partition_rows(reader, col, detail::sort_key(key, order), true);
+}
+
+template <class ReaderT>
+std::pair<size_t, size_t> equal_range(const ReaderT &reader, size_t col, double key,
+                                      key_order order = key_order::number) {
+  const detail::sort_key sort_key(key, order);
+  return {detail::partition_rows(reader, col, sort_key, false),
+          detail::partition_rows(reader, col, sort_key, true)};
+}
+
+template <class ReaderT>
+std::pair<size_t, size_t> equal_range(const ReaderT &reader, size_t col, std::string_view key,
+                                      key_order order = key_order::text) {
+  const detail::sort_key sort_key(key, order);
+  return {detail::partition_rows(reader, col, sort_key, false),
+          detail::partition_rows(reader, col, sort_key, true)};
+}
+
+} // namespace csv2
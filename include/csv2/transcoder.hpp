@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <csv2/reader.hpp>
+#include <csv2/writer.hpp>
+#include <string>
+#include <string_view>
+
+namespace csv2 {
+
+namespace detail {
+
+// Split one line of the input dialect into cells and hand them to the
+// writer, which re-quotes them for its own dialect
+template <char delimiter, char quote, class WriterT>
+void transcode_line(std::string_view line, WriterT &writer, std::string &scratch) {
+  constexpr auto npos = std::string_view::npos;
+  size_t i = 0;
+  for (;;) {
+    size_t stop;
+    if (i < line.size() && line[i] == quote) {
+      // quoted cell: runs to the closing quote, "" is an escaped quote
+      scratch.clear();
+      auto j = i + 1;
+      for (;;) {
+        const auto q = line.find(quote, j);
+        if (q == npos) { // unterminated, take the rest of the line
+          scratch.append(line.substr(j));
+          j = line.size();
+          break;
+        }
+        scratch.append(line.substr(j, q - j));
+        if (q + 1 < line.size() && line[q + 1] == quote) {
+          scratch.push_back(quote);
+          j = q + 2;
+        } else {
+          j = q + 1;
+          break;
+        }
+      }
+      // anything between the closing quote and the delimiter is kept
+      stop = std::min(line.find(delimiter, j), line.size());
+      scratch.append(line.substr(j, stop - j));
+      writer.field(std::string_view(scratch));
+    } else {
+      stop = std::min(line.find(delimiter, i), line.size());
+      writer.field(line.substr(i, stop - i));
+    }
+    if (stop == line.size())
+      break;
+    i = stop + 1; // a trailing delimiter yields a final empty cell
+  }
+}
+
+} // namespace detail
+
+// Rewrite the buffer of `reader` in the writer's dialect. Input is processed
+// in chunks of whole lines: a chunk without a quote character or the output
+// delimiter/quote is copied with only its delimiter bytes replaced, other
+// chunks are handled line by line and only the lines that need it are split
+// into cells and re-quoted. Rows are lines, as for Reader; cells are not
+// trimmed.
+template <class ReaderT, class delimiter, class quote_character, class sink>
+bool transcode(const ReaderT &reader, Writer<delimiter, quote_character, sink> &writer,
+               size_t chunk_size = 1024 * 1024) {
+  constexpr char in_delimiter = ReaderT::get_delimiter();
+  constexpr char in_quote = ReaderT::get_quote_ch();
+  constexpr char out_delimiter = delimiter::value;
+  constexpr char out_quote = quote_character::value;
+
+  const auto clean = [](const char *data, size_t size) {
+    return !detail::contains_any<in_quote, out_delimiter, out_quote>(data, size);
+  };
+
+  const char *buffer = reader.buffer();
+  const size_t buffer_size = reader.buffer_size();
+  std::string scratch;
+  bool unterminated = false; // the last line was copied without a newline
+  chunk_size = std::max<size_t>(chunk_size, 1);
+
+  for (size_t start = 0; start < buffer_size;) {
+    // extend the chunk to the end of its last line
+    auto end = std::min(start + chunk_size, buffer_size);
+    const auto newline =
+        static_cast<const char *>(memchr(buffer + end - 1, '\n', buffer_size - end + 1));
+    end = newline ? newline - buffer + 1 : buffer_size;
+
+    if (clean(buffer + start, end - start)) {
+      writer.write_raw(std::string_view(buffer + start, end - start), in_delimiter, out_delimiter);
+      unterminated = buffer[end - 1] != '\n';
+    } else {
+      for (auto line_start = start; line_start < end;) {
+        const auto found =
+            static_cast<const char *>(memchr(buffer + line_start, '\n', end - line_start));
+        const auto line_end = found ? static_cast<size_t>(found - buffer) : end;
+        std::string_view line(buffer + line_start, line_end - line_start);
+
+        if (clean(line.data(), line.size())) {
+          writer.write_raw(std::string_view(line.data(), line.size() + (found != nullptr)),
+                           in_delimiter, out_delimiter);
+          unterminated = !found;
+        } else {
+          const auto cr = !line.empty() && line.back() == '\r';
+          line.remove_suffix(cr);
+          detail::transcode_line<in_delimiter, in_quote>(line, writer, scratch);
+          if (cr)
+            writer.write_raw("\r");
+          writer.end_row();
+        }
+        line_start = line_end + 1;
+      }
+    }
+    start = end;
+  }
+
+  if (unterminated)
+    writer.end_row();
+  return !writer.error();
+}
+
+} // namespace csv2
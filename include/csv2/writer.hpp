@@ -0,0 +1,561 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <csv2/mio.hpp>
+#include <csv2/reader.hpp>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+
+namespace csv2 {
+
+namespace detail {
+
+// SWAR test for "any byte of `word` equals `c`": broadcast c to all eight
+// lanes, xor, then the classic has-zero-byte trick.
+constexpr uint64_t swar_ones = 0x0101010101010101ull;
+constexpr uint64_t swar_highs = 0x8080808080808080ull;
+
+inline uint64_t swar_match(uint64_t word, char c) {
+  const auto x = word ^ (swar_ones * static_cast<unsigned char>(c));
+  return (x - swar_ones) & ~x & swar_highs;
+}
+
+// True if any byte of [data, data + size) is one of `characters`. Scans
+// eight bytes at a time.
+template <char... characters> inline bool contains_any(const char *data, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    if ((swar_match(word, characters) | ...))
+      return true;
+  }
+  for (; i < size; ++i) {
+    if (((data[i] == characters) || ...))
+      return true;
+  }
+  return false;
+}
+
+// True if the field contains the delimiter, the quote character or a line
+// break, i.e. it must be quoted to round-trip
+template <char delimiter, char quote> inline bool needs_quoting(const char *data, size_t size) {
+  return contains_any<delimiter, quote, '\n', '\r'>(data, size);
+}
+
+// Copy [src, src + size) to dst, replacing every `from` byte with `to`.
+// swar_match() can flag a false positive next to a real match, which is fine
+// for "any" tests but not here, so this uses the exact per-byte zero test.
+inline void replace_bytes(char *dst, const char *src, size_t size, char from, char to) {
+  constexpr uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+  const auto from_word = swar_ones * static_cast<unsigned char>(from);
+  const auto to_word = swar_ones * static_cast<unsigned char>(to);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, src + i, 8);
+    const auto x = word ^ from_word;
+    const auto zero = ~(((x & low_bits) + low_bits) | x | low_bits); // 0x80 where x is 0
+    const auto mask = (zero >> 7) * 0xff;
+    word = (word & ~mask) | (to_word & mask);
+    memcpy(dst + i, &word, 8);
+  }
+  for (; i < size; ++i)
+    dst[i] = src[i] == from ? to : src[i];
+}
+
+// write() all of [data, data + size), retrying on EINTR and short writes
+inline bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    const auto n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+} // namespace detail
+
+// Sinks own the output buffer and hand the writer a window [cur, end) to
+// format into. reserve() commits everything before `cur` and makes at least
+// `n` bytes available; `cur == nullptr` means nothing has been written yet.
+
+// Buffered file descriptor: the window is a heap buffer, drained with write()
+class file_sink {
+  int fd_{-1};
+  bool owns_fd_{false};
+  bool error_{false};
+  std::unique_ptr<char[]> buffer_;
+  size_t capacity_{0};
+  size_t written_{0}; // bytes handed to the file so far
+
+public:
+  static constexpr size_t default_buffer_size = 1024 * 1024;
+
+  file_sink() = default;
+  file_sink(const file_sink &) = delete;
+  file_sink &operator=(const file_sink &) = delete;
+  ~file_sink() { close(nullptr); }
+
+  // Create/truncate `filename` and write to it
+  bool open(const std::string &filename, size_t buffer_size = default_buffer_size) {
+    const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return false;
+    attach_(fd, true, buffer_size);
+    return true;
+  }
+
+  // Write to an already open descriptor (e.g. STDOUT_FILENO); it is not closed
+  bool open(int fd, size_t buffer_size = default_buffer_size) {
+    if (fd < 0)
+      return false;
+    attach_(fd, false, buffer_size);
+    return true;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  size_t offset(const char *cur) const { return written_ + (cur ? cur - buffer_.get() : 0); }
+
+  bool reserve(char *&cur, char *&end, size_t n) {
+    flush(cur, end);
+    return n <= capacity_ && !error_;
+  }
+
+  bool flush(char *&cur, char *&end) {
+    const size_t used = cur ? cur - buffer_.get() : 0;
+    if (used > 0 && !error_)
+      error_ = !detail::write_all(fd_, buffer_.get(), used);
+    written_ += used;
+    cur = buffer_.get();
+    end = buffer_.get() + capacity_;
+    return !error_;
+  }
+
+  // Copy `size` bytes at `offset` of file `fd` behind the window without
+  // passing through user space. Returns how many bytes the kernel copied;
+  // the caller writes the rest itself.
+  size_t copy_file(int fd, size_t offset, size_t size, char *&cur, char *&end) {
+    size_t copied = 0;
+#ifdef __linux__
+    if (!flush(cur, end))
+      return 0;
+    auto in = static_cast<loff_t>(offset);
+    while (copied < size) {
+      const auto n = ::copy_file_range(fd, &in, fd_, nullptr, size - copied, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break; // e.g. EXDEV or a pipe on older kernels
+      copied += static_cast<size_t>(n);
+    }
+    written_ += copied;
+#else
+    (void)(fd), (void)(offset), (void)(size), (void)(cur), (void)(end);
+#endif
+    return copied;
+  }
+
+  bool close(char *cur) {
+    if (fd_ < 0)
+      return !error_;
+    char *end = nullptr;
+    flush(cur, end);
+    if (owns_fd_ && ::close(fd_) != 0)
+      error_ = true;
+    fd_ = -1;
+    owns_fd_ = false;
+    return !error_;
+  }
+
+private:
+  void attach_(int fd, bool owns, size_t buffer_size) {
+    fd_ = fd;
+    owns_fd_ = owns;
+    error_ = false;
+    written_ = 0;
+    buffer_size = std::max<size_t>(buffer_size, 4096);
+    if (capacity_ != buffer_size) {
+      buffer_.reset(new char[buffer_size]);
+      capacity_ = buffer_size;
+    }
+  }
+};
+
+// Appends to a caller-owned std::string, growing it geometrically
+class memory_sink {
+  std::string *out_{nullptr};
+  size_t base_{0};      // size of the string when opened
+  size_t committed_{0}; // bytes of the string in use when the window was last handed out
+
+public:
+  bool open(std::string &out) {
+    out_ = &out;
+    base_ = committed_ = out.size();
+    return true;
+  }
+
+  bool is_open() const { return out_ != nullptr; }
+  size_t offset(const char *cur) const { return (cur ? cur - out_->data() : committed_) - base_; }
+
+  bool reserve(char *&cur, char *&end, size_t n) {
+    const auto used = committed_ = cur ? cur - out_->data() : committed_;
+    if (used + n > out_->size())
+      out_->resize(std::max({out_->size() * 2, used + n, size_t(4096)}));
+    cur = out_->data() + used;
+    end = out_->data() + out_->size();
+    return true;
+  }
+
+  bool flush(char *&, char *&) { return true; }
+  size_t copy_file(int, size_t, size_t, char *&, char *&) { return 0; }
+
+  bool close(char *cur) {
+    if (!out_)
+      return true;
+    out_->resize(cur ? cur - out_->data() : committed_);
+    out_ = nullptr;
+    return true;
+  }
+};
+
+// Writable mapping of the output file: rows are formatted straight into the
+// page cache. The file is preallocated `extent` bytes at a time and the
+// mapping regrown as it fills; close() truncates it to the bytes written.
+class mapped_sink {
+  int fd_{-1};
+  bool error_{false};
+  mio::mmap_sink map_;
+  size_t extent_{0};
+  size_t allocated_{0}; // current file size
+  size_t committed_{0}; // bytes written when the window was last handed out
+
+public:
+  static constexpr size_t default_extent = 64 * 1024 * 1024;
+
+  mapped_sink() = default;
+  mapped_sink(const mapped_sink &) = delete;
+  mapped_sink &operator=(const mapped_sink &) = delete;
+  ~mapped_sink() { close(nullptr); }
+
+  // Create/truncate `filename`; `extent` is both the initial size and the growth step
+  bool open(const std::string &filename, size_t extent = default_extent) {
+    fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+      return false;
+    const auto page = mio::page_size();
+    extent_ = (std::max(extent, page) + page - 1) / page * page;
+    allocated_ = committed_ = 0;
+    error_ = false;
+    if (!grow_(extent_)) {
+      ::close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    return true;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  size_t offset(const char *cur) const {
+    return cur && map_.is_mapped() ? cur - map_.data() : committed_;
+  }
+
+  bool reserve(char *&cur, char *&end, size_t n) {
+    const auto used = committed_ = offset(cur);
+    if (used + n > allocated_ && !grow_(std::max(allocated_ + extent_, used + n))) {
+      cur = end = nullptr; // the old window is gone
+      return false;
+    }
+    cur = map_.data() + used;
+    end = map_.data() + allocated_;
+    return true;
+  }
+
+  // Nothing is buffered: the bytes are already in the page cache
+  bool flush(char *&, char *&) { return !error_; }
+  size_t copy_file(int, size_t, size_t, char *&, char *&) { return 0; }
+
+  bool close(char *cur) {
+    if (fd_ < 0)
+      return !error_;
+    const auto used = offset(cur);
+    map_.unmap();
+    if (::ftruncate(fd_, static_cast<off_t>(used)) != 0)
+      error_ = true;
+    if (::close(fd_) != 0)
+      error_ = true;
+    fd_ = -1;
+    allocated_ = 0;
+    return !error_;
+  }
+
+private:
+  bool grow_(size_t size) {
+    size = (size + extent_ - 1) / extent_ * extent_;
+    map_.unmap();
+#ifdef __linux__
+    // reserve real blocks so a full disk fails here rather than as SIGBUS
+    // on a page fault; fall back to a sparse file where unsupported
+    if (::fallocate(fd_, 0, static_cast<off_t>(allocated_),
+                    static_cast<off_t>(size - allocated_)) != 0 &&
+        (errno != EOPNOTSUPP || ::ftruncate(fd_, static_cast<off_t>(size)) != 0)) {
+#else
+    if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+#endif
+      error_ = true;
+      return false;
+    }
+    std::error_code error;
+    map_.map(fd_, 0, size, error);
+    if (error) {
+      error_ = true;
+      return false;
+    }
+#if defined(__linux__) && defined(MADV_POPULATE_WRITE)
+    // fault the new extent in with one call instead of a fault per page
+    ::madvise(map_.data() + allocated_, size - allocated_, MADV_POPULATE_WRITE);
+#endif
+    allocated_ = size;
+    return true;
+  }
+};
+
+// Buffered CSV writer. Rows are formatted into the sink's window: a large
+// buffer drained with write() by default, a std::string with memory_sink or
+// a writable mapping with mapped_sink.
+template <class delimiter, class quote_character, class sink = file_sink> class Writer {
+  sink sink_;
+  char *cur_{nullptr};
+  char *end_{nullptr};
+  bool error_{false};
+  bool first_field_{true}; // no delimiter before the next field
+  const char *run_begin_{nullptr}; // consecutive source rows queued by copy_row()
+  const char *run_end_{nullptr};
+  const char *source_{nullptr};    // buffer and file registered with copy_from()
+  size_t source_size_{0};
+  int source_fd_{-1};
+
+public:
+  Writer() = default;
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+  ~Writer() { close(); }
+
+  // Rows at least this long (in one run) are copied by the kernel when possible
+  static constexpr size_t copy_file_threshold = 64 * 1024;
+
+  // Arguments are forwarded to the sink, e.g. (filename, buffer_size) or
+  // (fd, buffer_size) for file_sink, (std::string &) for memory_sink and
+  // (filename, extent) for mapped_sink
+  template <typename... Args> bool open(Args &&... args) {
+    close();
+    error_ = false;
+    first_field_ = true;
+    source_ = nullptr;
+    source_fd_ = -1;
+    return sink_.open(std::forward<Args>(args)...);
+  }
+
+  bool is_open() const { return sink_.is_open(); }
+  bool error() const { return error_; }
+  size_t bytes_written() const {
+    return sink_.offset(cur_) + (run_begin_ ? run_end_ - run_begin_ + 1 : 0);
+  }
+
+  // Append one field to the current row. Accepts anything convertible to
+  // std::string_view, single characters, integers and floating point numbers.
+  template <typename T> bool field(const T &value) {
+    flush_run_();
+    if (!first_field_)
+      put_(delimiter::value);
+    first_field_ = false;
+    put_field_(value);
+    return !error_;
+  }
+
+  // Terminate the current row
+  bool end_row() {
+    flush_run_();
+    put_('\n');
+    first_field_ = true;
+    return !error_;
+  }
+
+  template <typename... Fields> bool write_row(const Fields &... fields) {
+    (field(fields), ...);
+    return end_row();
+  }
+
+  // Write every element of a container/range as one row
+  template <typename Range> bool write_fields(const Range &range) {
+    for (const auto &value : range)
+      field(value);
+    return end_row();
+  }
+
+  // Append bytes verbatim; the caller is responsible for the dialect
+  bool write_raw(std::string_view data) {
+    flush_run_();
+    put_(data.data(), data.size());
+    return !error_;
+  }
+
+  // Same, replacing every `from` byte with `to` on the way
+  bool write_raw(std::string_view data, char from, char to) {
+    flush_run_();
+    auto src = data.data();
+    auto size = data.size();
+    while (size > 0 && reserve_(1)) {
+      const auto n = std::min(size, static_cast<size_t>(end_ - cur_));
+      detail::replace_bytes(cur_, src, n, from, to);
+      cur_ += n;
+      src += n;
+      size -= n;
+    }
+    return !error_;
+  }
+
+  // Rows passed to copy_row() come from `reader`: when it is mmap'd from a
+  // file, long runs of consecutive rows are copied file to file
+  // (copy_file_range) when the sink supports it
+  template <class ReaderT> void copy_from(const ReaderT &reader) {
+    flush_run_();
+    source_ = reader.buffer();
+    source_size_ = reader.buffer_size();
+    source_fd_ = reader.file_handle();
+  }
+
+  // Emit a Reader row's original bytes and a newline, without re-serializing
+  // its cells. Rows that follow each other in the source are coalesced into
+  // a single copy.
+  template <class RowT> bool copy_row(const RowT &row) {
+    const auto bytes = row.as_string();
+    if (!(run_begin_ && bytes.data() == run_end_ + 1 && *run_end_ == '\n')) {
+      flush_run_();
+      run_begin_ = bytes.data();
+    }
+    run_end_ = bytes.data() + bytes.size();
+    return !error_;
+  }
+
+  bool flush() {
+    flush_run_();
+    if (!sink_.flush(cur_, end_))
+      error_ = true;
+    return !error_;
+  }
+
+  bool close() {
+    if (!sink_.is_open())
+      return !error_;
+    flush_run_();
+    if (!sink_.close(cur_))
+      error_ = true;
+    cur_ = end_ = nullptr;
+    first_field_ = true;
+    return !error_;
+  }
+
+private:
+  void flush_run_() {
+    if (!run_begin_)
+      return;
+    auto begin = run_begin_;
+    auto size = static_cast<size_t>(run_end_ - run_begin_);
+    run_begin_ = run_end_ = nullptr;
+    if (source_fd_ != mio::invalid_handle && size >= copy_file_threshold && begin >= source_ &&
+        begin + size <= source_ + source_size_) {
+      const auto copied = sink_.copy_file(source_fd_, begin - source_, size, cur_, end_);
+      begin += copied;
+      size -= copied;
+    }
+    put_(begin, size);
+    put_('\n');
+  }
+
+  // Make room for n contiguous bytes
+  bool reserve_(size_t n) {
+    if (static_cast<size_t>(end_ - cur_) >= n)
+      return true;
+    if (!error_ && sink_.reserve(cur_, end_, n))
+      return true;
+    error_ = true;
+    return false;
+  }
+
+  void put_(char c) {
+    if (reserve_(1))
+      *cur_++ = c;
+  }
+
+  void put_(const char *data, size_t size) {
+    while (size > 0 && reserve_(1)) {
+      const auto n = std::min(size, static_cast<size_t>(end_ - cur_));
+      memcpy(cur_, data, n);
+      cur_ += n;
+      data += n;
+      size -= n;
+    }
+  }
+
+  void put_quoted_(const char *data, size_t size) {
+    constexpr char quote = quote_character::value;
+    put_(quote);
+    for (;;) {
+      const auto q = static_cast<const char *>(memchr(data, quote, size));
+      const auto n = q ? static_cast<size_t>(q - data) + 1 : size;
+      put_(data, n);
+      if (!q)
+        break;
+      put_(quote); // "" escapes an embedded quote
+      data += n;
+      size -= n;
+    }
+    put_(quote);
+  }
+
+  void put_string_(std::string_view value) {
+    if (detail::needs_quoting<delimiter::value, quote_character::value>(value.data(),
+                                                                        value.size()))
+      put_quoted_(value.data(), value.size());
+    else
+      put_(value.data(), value.size());
+  }
+
+  template <typename T> void put_field_(const T &value) {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, char>) {
+      put_string_(std::string_view(&value, 1));
+    } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+      put_string_(std::string_view(value));
+    } else if constexpr (std::is_arithmetic_v<U> && !std::is_same_v<U, bool>) {
+      // 32 bytes covers every integer and the shortest round-trip double
+      constexpr size_t max_chars = 32;
+      if (!reserve_(max_chars))
+        return;
+      cur_ = std::to_chars(cur_, cur_ + max_chars, value).ptr;
+    } else {
+      static_assert(std::is_arithmetic_v<U> && !std::is_same_v<U, bool>,
+                    "unsupported field type");
+    }
+  }
+};
+
+template <class delimiter, class quote_character>
+using MappedWriter = Writer<delimiter, quote_character, mapped_sink>;
+
+} // namespace csv2
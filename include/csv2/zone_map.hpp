@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <csv2/column.hpp>
+#include <csv2/file_stamp.hpp>
+#include <csv2/filter.hpp>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace csv2 {
+
+// Smallest and largest value of the numeric and timestamp columns of every
+// block of `block_rows` data rows, with how many cells were empty or not a
+// value. Range predicates skip the blocks that cannot match and take every
+// row of the blocks that lie inside the range without reading them. Build it
+// once the rows are indexed and save() it next to the file to reuse it; a
+// saved map only loads for the file it was built from (see file_stamp).
+class ZoneMap : public detail::row_blocks {
+public:
+  enum class value_kind : uint8_t { none, number, timestamp };
+
+  struct Zone {
+    double min{std::numeric_limits<double>::infinity()};
+    double max{-std::numeric_limits<double>::infinity()};
+    uint64_t missing{0}; // empty cells
+    uint64_t invalid{0}; // non-empty cells that are not a value of the column's kind
+  };
+
+private:
+  static constexpr uint32_t version_ = 3;
+
+  file_stamp source_;
+  std::vector<value_kind> kinds_; // per column
+  std::vector<Zone> zones_;       // zones_[block * cols + col]
+
+  // Numbers as infer_schema() sees them; string columns whose sampled
+  // non-empty cells are all timestamps
+  template <class ReaderT> static std::vector<value_kind> infer_kinds_(const ReaderT &reader) {
+    const auto types = infer_schema(reader);
+    std::vector<value_kind> kinds(types.size(), value_kind::none);
+    std::vector<bool> timestamps(types.size(), true), seen(types.size(), false);
+    const size_t samples = std::min<size_t>(reader.size(), 1024);
+    for (size_t i = 0; i < samples; ++i) {
+      const auto row = reader[i * reader.size() / samples];
+      auto cell = row.begin();
+      for (size_t col = 0; col < types.size(); ++col, ++cell) {
+        const auto value = detail::strip_cell((*cell).raw_view(), reader.get_quote_ch());
+        double ignored;
+        if (value.empty() || types[col] != column_type::string)
+          continue;
+        seen[col] = true;
+        timestamps[col] = timestamps[col] && parse_timestamp(value, ignored);
+      }
+    }
+    for (size_t col = 0; col < types.size(); ++col)
+      if (types[col] != column_type::string)
+        kinds[col] = value_kind::number;
+      else if (seen[col] && timestamps[col])
+        kinds[col] = value_kind::timestamp;
+    return kinds;
+  }
+
+public:
+  static std::string sidecar_path(const std::string &filename) { return filename + ".csv2zone"; }
+
+  // One pass over the data rows indexed so far; column kinds are guessed
+  // from a sample of them
+  template <class ReaderT> bool build(const ReaderT &reader, size_t block_rows = 65536) {
+    *this = ZoneMap();
+    const size_t cols = reader.cols();
+    if (cols == 0)
+      return false;
+    block_rows_ = std::max<size_t>(block_rows, 1);
+    source_ = file_stamp::of_reader(reader);
+    rows_ = reader.size();
+    kinds_ = infer_kinds_(reader);
+    zones_.resize(blocks() * cols);
+
+    size_t width = 0;
+    for (size_t col = 0; col < cols; ++col)
+      if (kinds_[col] != value_kind::none)
+        width = col + 1;
+    const auto quote = reader.get_quote_ch();
+    auto it = reader.begin();
+    for (size_t irow = 0; irow < rows_ && width > 0; ++irow, ++it) {
+      auto zone = zones_.begin() + (irow / block_rows_) * cols;
+      const auto row = *it;
+      auto cell = row.begin();
+      for (size_t col = 0; col < width; ++col, ++cell, ++zone) {
+        if (kinds_[col] == value_kind::none)
+          continue;
+        const auto value = detail::strip_cell((*cell).raw_view(), quote);
+        double number;
+        if (value.empty())
+          ++zone->missing;
+        else if ((kinds_[col] == value_kind::number ? detail::parse_number(value, number, quote)
+                                                    : parse_timestamp(value, number, quote)) &&
+                 number == number) { // NaN never satisfies a range
+          zone->min = std::min(zone->min, number);
+          zone->max = std::max(zone->max, number);
+        } else
+          ++zone->invalid;
+      }
+    }
+    return true;
+  }
+
+  bool save(const std::string &path) const {
+    detail::sidecar_writer out(path, "CSV2ZMAP", version_, source_);
+    out.write(rows_);
+    out.write(block_rows_);
+    out.write(static_cast<uint64_t>(kinds_.size()));
+    out.write(kinds_.data(), kinds_.size());
+    out.write(zones_.data(), zones_.size());
+    return out.close();
+  }
+
+  // Loads a zone map saved for the file stamped `source`
+  bool load(const std::string &path, const file_stamp &source) {
+    detail::sidecar_reader in;
+    ZoneMap zones;
+    uint64_t cols{0}, count;
+    // every row takes at least a byte of the file
+    if (!in.open(path, "CSV2ZMAP", version_, source) || !in.read(zones.rows_) ||
+        !in.read(zones.block_rows_) || !in.read(cols) || zones.rows_ > source.size ||
+        zones.block_rows_ == 0 || cols == 0 || cols > (uint64_t(1) << 20) ||
+        !detail::checked_mul(zones.blocks(), cols, count) || !in.read(zones.kinds_, cols) ||
+        !in.read(zones.zones_, count) || in.remaining() != 0)
+      return false;
+    for (const auto kind : zones.kinds_)
+      if (kind > value_kind::timestamp)
+        return false;
+    zones.source_ = source;
+    *this = std::move(zones);
+    return true;
+  }
+
+  size_t cols() const { return kinds_.size(); }
+  auto kind(size_t col) const { return col < kinds_.size() ? kinds_[col] : value_kind::none; }
+  const Zone &zone(size_t block, size_t col) const { return zones_[block * cols() + col]; }
+
+  // Whether a value of column `col` in [low, high] may be in the block
+  bool may_match(size_t block, size_t col, double low, double high) const {
+    const auto &z = zone(block, col);
+    return z.min <= high && z.max >= low;
+  }
+
+  // Whether every row of the block has a value in [low, high]
+  bool all_match(size_t block, size_t col, double low, double high) const {
+    const auto &z = zone(block, col);
+    return z.missing == 0 && z.invalid == 0 && low <= z.min && z.max <= high;
+  }
+
+  // Row ranges [first, last) that may hold a value of column `col` in
+  // [low, high], adjacent blocks merged; all rows if the column has no zones
+  std::vector<std::pair<size_t, size_t>> row_ranges(size_t col, double low, double high) const {
+    return row_ranges_([&](size_t block) {
+      return kind(col) == value_kind::none || may_match(block, col, low, high);
+    });
+  }
+};
+
+namespace detail {
+
+// for_each_match() over the blocks of `zones` a range predicate can match;
+// other predicates, other columns and zone maps built over a different
+// number of rows scan every row
+template <class ReaderT, class F>
+void for_each_match(const ReaderT &reader, size_t col, const predicate &test, const ZoneMap &zones,
+                    size_t size, F &&f) {
+  const auto kind = test.type() == predicate::kind::between        ? ZoneMap::value_kind::number
+                    : test.type() == predicate::kind::time_between ? ZoneMap::value_kind::timestamp
+                                                                   : ZoneMap::value_kind::none;
+  if (kind == ZoneMap::value_kind::none || zones.kind(col) != kind || zones.rows() != size) {
+    for_each_match(reader, col, test, 0, size, f);
+    return;
+  }
+  for (size_t block = 0; block < zones.blocks(); ++block) {
+    const auto [first, last] = zones.block_span(block);
+    if (zones.all_match(block, col, test.low(), test.high()))
+      for (size_t irow = first; irow < last; ++irow)
+        f(irow);
+    else if (zones.may_match(block, col, test.low(), test.high()))
+      for_each_match(reader, col, test, first, last, f);
+  }
+}
+
+} // namespace detail
+
+// filter_bitmap() and filter_rows() reading only the blocks of the zone map
+// whose values may be in the range of a between or time_between predicate
+template <class ReaderT>
+std::vector<uint64_t> filter_bitmap(const ReaderT &reader, size_t col, const predicate &test,
+                                    const ZoneMap &zones) {
+  const size_t size = reader.size();
+  std::vector<uint64_t> result((size + 63) / 64);
+  detail::for_each_match(reader, col, test, zones, size,
+                         [&](size_t irow) { result[irow / 64] |= uint64_t(1) << (irow % 64); });
+  return result;
+}
+
+template <class ReaderT>
+std::vector<size_t> filter_rows(const ReaderT &reader, size_t col, const predicate &test,
+                                const ZoneMap &zones) {
+  std::vector<size_t> result;
+  detail::for_each_match(reader, col, test, zones, reader.size(),
+                         [&](size_t irow) { result.push_back(irow); });
+  return result;
+}
+
+} // namespace csv2
@@ -1,21 +1,51 @@
-
 #include <boost/python/iterator.hpp>
 #include <boost/python/module.hpp>
 #include <boost/python/class.hpp>
+#include <boost/python/def.hpp>
+#include <boost/python/dict.hpp>
+#include <boost/python/import.hpp>
+#include <boost/python/list.hpp>
+#include <boost/python/manage_new_object.hpp>
+#include <boost/python/return_value_policy.hpp>
+#include <boost/python/tuple.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
 #include <boost/python/slice.hpp>
+#include <boost/python/stl_iterator.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/python/return_arg.hpp>
+#include "csv2/aggregate.hpp"
+#include "csv2/bloom_filter.hpp"
+#include "csv2/column.hpp"
+#include "csv2/filter.hpp"
+#include "csv2/hash_index.hpp"
 #include "csv2/reader.hpp"
+#include "csv2/search.hpp"
+#include "csv2/sorted.hpp"
+#include "csv2/zone_map.hpp"
 #include <stdexcept>
+#include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 namespace bp=boost::python;
 using namespace csv2;
-template<typename T>
-bool mmap_wraper(T* pSelf, const std::string& p)
+
+// Releases the GIL for the lifetime of the object. Only wrap pure C++ work:
+// no Python objects may be touched until it is destroyed.
+class ScopedGILRelease
 {
-    return pSelf->mmap(p);
-}
+    PyThreadState* state_;
+public:
+    ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+    ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+    ScopedGILRelease(const ScopedGILRelease&) = delete;
+    ScopedGILRelease& operator=(const ScopedGILRelease&) = delete;
+};
+
 
 template<typename C>
 std::string to_string_wraper(C* pSelf)
@@ -30,102 +60,1219 @@ std::string get_prefix_wraper(C* pSelf, char c)
     auto sv = pSelf->get_prefix(c);
     return std::string(sv.begin(), sv.end()); 
 }
-// std::ofstream f("/tmp/pp", std::ios::out|std::ios::binary);
+// Python-side Row: remembers the last cell it looked up so that row[0],
+// row[1], ... walks the row once. Python objects are only touched with the
+// GIL held, which also serializes access to the cursor.
+template<typename R>
+struct PyRow : R
+{
+    std::optional<typename R::iterator> cursor;
+
+    PyRow(PyObject*) {}
+    PyRow(PyObject*, const R& row) : R(row) {}
+};
+
 template<typename R>
-auto get_cell_wraper(R* pSelf, int idx)
+auto get_cell_wraper(bp::back_reference<R&> ref, int idx)
 {
-    static typename R::iterator LAST_IT = pSelf->begin();
-    if(idx >= pSelf->size())
+    const R& self = ref.get();
+    if(idx < 0)
+    {
+        idx += self.size();
+    }
+    if(idx < 0 || idx >= self.size())
     {
         auto errMsg = std::string("cell index out_of_range ");
         errMsg += std::to_string(idx);
         errMsg += " not in range [0,";
-        errMsg += std::to_string(pSelf->size());
+        errMsg += std::to_string(self.size());
         errMsg += ")";
         throw std::out_of_range(errMsg);
     }
 
-    idx %= pSelf->size();
-    if(!(idx >= LAST_IT.cell_no() && pSelf->is_in(LAST_IT)))
+    // rows handed out by reference (e.g. header()) have no cursor to keep
+    std::optional<typename R::iterator> local;
+    bp::extract<PyRow<R>&> py_row(ref.source());
+    auto& cursor = py_row.check() ? py_row().cursor : local;
+    if(!cursor || idx < cursor->cell_no())
     {
-        // f << "change cache 11" << std::endl;
-        LAST_IT = pSelf->begin();
+        cursor = self.begin();
     }
-    // else
-    // {
-    //     f << "no change self:" << pSelf->as_string() << std::endl;
-    // }
-    
 
-    while(LAST_IT.cell_no() < idx)
+    while(cursor->cell_no() < idx)
     {
-        ++LAST_IT;
+        ++*cursor;
     }
-    // f << "[" << pSelf->line_no() << "," << idx << "]=" << (*LAST_IT).as_string() <<std::endl;
-    return *LAST_IT;
+    return **cursor;
 }
 
-template<typename IT>
-struct RowRange {
-    IT beg, ed;
-    IT begin() const { return beg; }
-    IT end() const { return ed; }
-    using iterator = IT;
+// Python-side Reader: keeps its own row cursor so sequential and nearby
+// csv[i] lookups only walk the distance from the previous one. Lookups run
+// without the GIL, so the cursor has its own lock. So does the buffer: mmap()
+// holds buffer_mutex exclusively while it remaps the file and drops the zone
+// map, Bloom filter and hash indexes, every other call holds it shared for
+// as long as it reads them (see lock_buffer). Those sidecars are otherwise
+// only replaced while holding the GIL.
+template<typename C>
+struct PyReader : C
+{
+    mutable std::shared_mutex buffer_mutex;
+    std::mutex cursor_mutex;
+    std::optional<typename C::iterator> cursor;
+    std::string path;
+    std::shared_ptr<const csv2::ZoneMap> zones;
+    std::shared_ptr<const csv2::BloomFilter> bloom;
+    std::map<size_t, std::shared_ptr<const csv2::HashIndex>> hash_indexes; // by column
+
+    PyReader(PyObject*) {}
 };
 
+// Holds the buffer of the reader shared for the rest of a call: another
+// thread's mmap() waits until it is released. It is taken without the GIL, so
+// a thread waiting for it never blocks one that holds it and needs the GIL
+// back. Take it once per call, before reading the buffer, the row count or
+// the sidecars.
 template<typename C>
-RowRange<typename C::iterator> get_slice_wraper(C* pSelf, bp::slice s)
+std::shared_lock<std::shared_mutex> lock_buffer(const PyReader<C>& self)
 {
-    auto start = s.start();
-    auto stop = s.stop();
-    auto step = s.step();
-    
-    auto startv = start.is_none() ? 0LU : (size_t)bp::extract<size_t>(start);
-    auto endv = stop.is_none() ? pSelf->size() : (size_t)bp::extract<size_t>(stop);
+    ScopedGILRelease nogil;
+    return std::shared_lock<std::shared_mutex>(self.buffer_mutex);
+}
 
-    typename C::iterator beg = (*pSelf)(startv);
-    typename C::iterator end = (*pSelf)(endv);
-    
-    return RowRange<typename C::iterator>{beg, end};
+template<typename C>
+bool mmap_wraper(PyReader<C>& self, const std::string& p)
+{
+    ScopedGILRelease nogil;
+    std::unique_lock<std::shared_mutex> remap(self.buffer_mutex);
+    std::lock_guard<std::mutex> lock(self.cursor_mutex);
+    self.path = p;
+    self.zones.reset();
+    self.bloom.reset();
+    self.hash_indexes.clear();
+    self.cursor.reset();
+    return self.mmap(p);
+}
+
+template<typename C>
+bool mmap_async_wraper(PyReader<C>& self, const std::string& p)
+{
+    ScopedGILRelease nogil;
+    std::unique_lock<std::shared_mutex> remap(self.buffer_mutex);
+    std::lock_guard<std::mutex> lock(self.cursor_mutex);
+    self.path = p;
+    self.zones.reset();
+    self.bloom.reset();
+    self.hash_indexes.clear();
+    self.cursor.reset();
+    return self.mmap_async(p);
+}
+
+template<typename C>
+void wait_indexed_wraper(const PyReader<C>& self)
+{
+    const auto held = lock_buffer(self);
+    ScopedGILRelease nogil;
+    self.wait_indexed();
+}
+
+// Rows start, start + step, ... (count of them) of a reader, as selected by
+// csv[a:b:c]. Rows are looked up through the reader's row index when needed;
+// iterating with a small step walks from the previous row instead.
+template<typename C>
+struct RowSlice
+{
+    const PyReader<C>* reader;
+    int64_t start, step, count;
+
+    class iterator
+    {
+        const RowSlice* slice_;
+        int64_t pos_;
+        std::optional<typename C::iterator> row_;
+
+        void resolve_()
+        {
+            if(!row_)
+            {
+                row_ = (*slice_->reader)(slice_->start + pos_ * slice_->step);
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename C::Row;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = typename C::Row;
+
+        iterator(const RowSlice* slice, int64_t pos) : slice_(slice), pos_(pos) {}
+
+        reference operator*()
+        {
+            resolve_();
+            return **row_;
+        }
+
+        iterator& operator++()
+        {
+            ++pos_;
+            const auto step = slice_->step;
+            if(row_ && pos_ < slice_->count && std::abs(step) < int64_t(C::row_index_stride))
+            {
+                if(step > 0)
+                    *row_ += step;
+                else
+                    *row_ -= -step;
+            }
+            else
+            {
+                row_.reset();
+            }
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            // resolve first so that this iterator can walk on from the row
+            resolve_();
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const iterator& rhs) const { return pos_ == rhs.pos_; }
+        bool operator!=(const iterator& rhs) const { return pos_ != rhs.pos_; }
+    };
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, count); }
+    int64_t size() const { return count; }
+};
+
+template<typename C>
+RowSlice<C> get_slice_wraper(PyReader<C>* pSelf, bp::slice s)
+{
+    const auto held = lock_buffer(*pSelf);
+    Py_ssize_t start, stop, step;
+    if(PySlice_Unpack(s.ptr(), &start, &stop, &step) < 0)
+    {
+        bp::throw_error_already_set();
+    }
+    const auto count = PySlice_AdjustIndices(pSelf->size(), &start, &stop, step);
+    return RowSlice<C>{pSelf, start, step, count};
+}
+
+template<typename C>
+auto get_slice_row_wraper(const RowSlice<C>& self, int64_t idx)
+{
+    const auto held = lock_buffer(*self.reader);
+    if(idx < 0)
+    {
+        idx += self.count;
+    }
+    if(idx < 0 || idx >= self.count)
+    {
+        throw std::out_of_range("slice index out of range " + std::to_string(idx));
+    }
+    ScopedGILRelease nogil;
+    return (*self.reader)[self.start + idx * self.step];
 }
 
+// Move the reader's cursor to data row idx: rows close to the previous
+// position are walked to, others are looked up through the row index. Call
+// with cursor_mutex held.
 template<typename C>
-auto get_row_wraper(C* self, int64_t idx)
+typename C::iterator& seek_row(PyReader<C>& self, int64_t idx)
 {
-    static typename C::iterator LAST_IT = self->begin();
-    if(idx > 0 && idx >= self->size())
+    auto& cursor = self.cursor;
+    const int64_t step_2_last = idx - (cursor ? cursor->line_no() : 0);
+    if(cursor && std::abs(step_2_last) < int64_t(C::row_index_stride))
+    {
+        if(step_2_last > 0)
+        {
+            *cursor += step_2_last;
+        }
+        else if(step_2_last < 0)
+        {
+            *cursor -= -step_2_last;
+        }
+    }
+    else
+    {
+        cursor = self(idx);
+    }
+    return *cursor;
+}
+
+template<typename C>
+auto get_row_wraper(PyReader<C>& self, int64_t idx)
+{
+    const auto held = lock_buffer(self);
+    const int64_t size = self.size();
+    if(idx < 0)
+    {
+        idx += size;
+    }
+    if(idx < 0 || idx >= size)
     {
         auto errMsg = std::string("row index out_of_range ");
         errMsg += std::to_string(idx);
         errMsg += " not in range [0,";
-        errMsg += std::to_string(self->size());
+        errMsg += std::to_string(size);
         errMsg += ")";
         throw std::out_of_range(errMsg);
     }
 
-    idx %= self->size();
+    ScopedGILRelease nogil;
+    std::lock_guard<std::mutex> lock(self.cursor_mutex);
+    return *seek_row(self, idx);
+}
 
-    auto step_2_last = idx-LAST_IT.line_no();
-    auto step_2_begin = idx;
-    auto step_2_end = self->size() - idx;
-    if(LAST_IT.buffer() == self->buffer() && std::abs(step_2_last) < step_2_begin && std::abs(step_2_last) < step_2_end)
+inline PyObject* to_py_str(std::string_view sv)
+{
+    auto str = PyUnicode_FromStringAndSize(sv.data(), sv.size());
+    if(!str)
     {
-        if(step_2_last > 0)
+        bp::throw_error_already_set();
+    }
+    return str;
+}
+
+// Rows [start, stop) (slice-style bounds) as a list of tuples of str, or a
+// dict {column: list of str} with as_dict. The rows are walked without the
+// GIL and every Python object is then built in a single pass.
+template<typename C>
+bp::object fetch_wraper(PyReader<C>& self, int64_t start, int64_t stop,
+                        bp::object columns, bool as_dict)
+{
+    // held until the cells are copied into Python strings
+    const auto held = lock_buffer(self);
+    const int64_t size = self.size();
+    start = start < 0 ? std::max<int64_t>(start + size, 0) : std::min(start, size);
+    stop = stop < 0 ? std::max<int64_t>(stop + size, 0) : std::min(stop, size);
+    const size_t rows = std::max<int64_t>(stop - start, 0);
+
+    std::vector<size_t> cols;
+    if(columns.is_none())
+    {
+        for(size_t i = 0; i < (size_t)self.cols(); ++i)
         {
-            LAST_IT += step_2_last;
+            cols.push_back(i);
         }
-        else if(step_2_last < 0)
+    }
+    else
+    {
+        for(bp::stl_input_iterator<int64_t> it(columns), end; it != end; ++it)
         {
-            LAST_IT -= -step_2_last;
+            const auto col = *it < 0 ? *it + self.cols() : *it;
+            if(col < 0 || col >= self.cols())
+            {
+                throw std::out_of_range("column index out_of_range " + std::to_string(*it));
+            }
+            cols.push_back(col);
+        }
+    }
+    const size_t width = cols.empty() ? 0 : *std::max_element(cols.begin(), cols.end()) + 1;
+
+    // cells[r * cols.size() + c] is column cols[c] of row start + r
+    std::vector<std::string_view> cells(rows * cols.size());
+    if(rows > 0 && !cols.empty())
+    {
+        ScopedGILRelease nogil;
+        std::lock_guard<std::mutex> lock(self.cursor_mutex);
+        auto& it = seek_row(self, start);
+        std::vector<std::string_view> row_cells(width);
+        for(size_t r = 0; ; )
+        {
+            const auto row = *it;
+            auto cell = row.begin();
+            for(size_t c = 0; c < width; ++c, ++cell)
+            {
+                row_cells[c] = (*cell).as_string();
+            }
+            for(size_t c = 0; c < cols.size(); ++c)
+            {
+                cells[r * cols.size() + c] = row_cells[cols[c]];
+            }
+            if(++r == rows)
+            {
+                break;
+            }
+            ++it;
+        }
+    }
+
+    if(as_dict)
+    {
+        bp::dict result;
+        for(size_t c = 0; c < cols.size(); ++c)
+        {
+            bp::object list{bp::handle<>(PyList_New(rows))};
+            for(size_t r = 0; r < rows; ++r)
+            {
+                PyList_SET_ITEM(list.ptr(), r, to_py_str(cells[r * cols.size() + c]));
+            }
+            result[cols[c]] = list;
+        }
+        return std::move(result);
+    }
+
+    bp::object result{bp::handle<>(PyList_New(rows))};
+    for(size_t r = 0; r < rows; ++r)
+    {
+        auto tuple = PyTuple_New(cols.size());
+        PyList_SET_ITEM(result.ptr(), r, tuple);
+        for(size_t c = 0; c < cols.size(); ++c)
+        {
+            PyTuple_SET_ITEM(tuple, c, to_py_str(cells[r * cols.size() + c]));
+        }
+    }
+    return result;
+}
+
+// Parse a column into a bytearray and return a typed memoryview over it, so
+// the values reach Python (and numpy.asarray) without per-cell objects
+template<typename T, typename C>
+bp::object read_column_as(PyReader<C>* pSelf, size_t idx, const char* format, const std::string& dtype)
+{
+    const auto held = lock_buffer(*pSelf);
+    if(idx >= (size_t)pSelf->cols())
+    {
+        throw std::out_of_range("column index out_of_range " + std::to_string(idx));
+    }
+
+    {
+        ScopedGILRelease nogil;
+        pSelf->wait_indexed();
+    }
+    const auto rows = pSelf->size();
+    bp::object buffer{bp::handle<>(PyByteArray_FromStringAndSize(nullptr, rows * sizeof(T)))};
+    auto data = reinterpret_cast<T*>(PyByteArray_AS_STRING(buffer.ptr()));
+    size_t missing;
+    {
+        // nothing else holds a reference to the new bytearray yet
+        ScopedGILRelease nogil;
+        missing = read_column(*pSelf, idx, data);
+    }
+    if(std::is_integral<T>::value && missing > 0)
+    {
+        throw std::invalid_argument(std::to_string(missing) + " cells of column " +
+                                    std::to_string(idx) + " are not " + dtype);
+    }
+
+    bp::object view{bp::handle<>(PyMemoryView_FromObject(buffer.ptr()))};
+    return view.attr("cast")(format);
+}
+
+template<typename C>
+bp::object read_column_wraper(PyReader<C>* pSelf, size_t idx, const std::string& dtype)
+{
+    if(dtype == "float64" || dtype == "f8" || dtype == "d")
+        return read_column_as<double>(pSelf, idx, "d", dtype);
+    if(dtype == "float32" || dtype == "f4" || dtype == "f")
+        return read_column_as<float>(pSelf, idx, "f", dtype);
+    if(dtype == "int64" || dtype == "i8" || dtype == "q")
+        return read_column_as<int64_t>(pSelf, idx, "q", dtype);
+    if(dtype == "int32" || dtype == "i4" || dtype == "i")
+        return read_column_as<int32_t>(pSelf, idx, "i", dtype);
+    throw std::invalid_argument("unsupported dtype " + dtype);
+}
+
+// A cell of a string column: None when empty, doubled quotes unescaped
+inline PyObject* to_py_cell(std::string_view sv, char quote)
+{
+    if(sv.empty())
+    {
+        Py_RETURN_NONE;
+    }
+    if(sv.find(quote) == std::string_view::npos)
+    {
+        return to_py_str(sv);
+    }
+    std::string value;
+    for(size_t i = 0; i < sv.size(); ++i)
+    {
+        value.push_back(sv[i]);
+        i += sv[i] == quote && i + 1 < sv.size() && sv[i + 1] == quote;
+    }
+    return to_py_str(value);
+}
+
+inline csv2::column_type parse_column_type(const std::string& dtype)
+{
+    if(dtype == "int64" || dtype == "i8" || dtype == "q")
+        return csv2::column_type::integer;
+    if(dtype == "float64" || dtype == "f8" || dtype == "d")
+        return csv2::column_type::floating;
+    if(dtype == "str" || dtype == "object" || dtype == "O")
+        return csv2::column_type::string;
+    throw std::invalid_argument("unsupported dtype " + dtype);
+}
+
+// One column of to_dict_of_arrays: numbers go straight into a bytearray,
+// strings are collected as views and turned into objects at the end
+struct PyColumn
+{
+    size_t col;
+    csv2::column_type type;
+    bool inferred;
+    bp::object buffer;
+    std::vector<std::string_view> strings;
+
+    csv2::column_output output(size_t rows)
+    {
+        csv2::column_output result{col, csv2::column_destination{}};
+        if(type == csv2::column_type::string)
+        {
+            strings.resize(rows);
+            result.data = strings.data();
+            return result;
+        }
+        buffer = bp::object{bp::handle<>(PyByteArray_FromStringAndSize(nullptr, rows * 8))};
+        const auto data = PyByteArray_AS_STRING(buffer.ptr());
+        if(type == csv2::column_type::integer)
+            result.data = reinterpret_cast<int64_t*>(data);
+        else
+            result.data = reinterpret_cast<double*>(data);
+        return result;
+    }
+};
+
+// {column index: array} for the columns of `schema` ({column index: dtype or
+// None}), or every column when it is None. Missing dtypes are inferred from a
+// sample of the rows; a column whose later rows do not fit the guess is read
+// again with the next wider type. Numeric columns are numpy arrays when numpy
+// is importable and typed memoryviews otherwise; string columns are object
+// arrays (lists) with None for empty cells. All cells are parsed in one pass
+// without the GIL.
+template<typename C>
+bp::object to_dict_of_arrays_wraper(PyReader<C>* pSelf, bp::object schema)
+{
+    // held until the string cells are copied into Python objects
+    const auto held = lock_buffer(*pSelf);
+    std::vector<csv2::column_type> inferred;
+    {
+        ScopedGILRelease nogil;
+        pSelf->wait_indexed();
+        inferred = csv2::infer_schema(*pSelf);
+    }
+    const size_t rows = pSelf->size();
+    const int64_t cols = pSelf->cols();
+
+    std::vector<PyColumn> columns;
+    if(schema.is_none())
+    {
+        for(int64_t col = 0; col < cols; ++col)
+        {
+            columns.push_back(PyColumn{size_t(col), inferred[col], true});
         }
     }
     else
     {
-        LAST_IT = (*self)(idx);
+        bp::dict dtypes(schema);
+        bp::list keys = dtypes.keys();
+        for(bp::ssize_t i = 0; i < bp::len(keys); ++i)
+        {
+            const int64_t key = bp::extract<int64_t>(keys[i]);
+            const auto col = key < 0 ? key + cols : key;
+            if(col < 0 || col >= cols)
+            {
+                throw std::out_of_range("column index out_of_range " + std::to_string(key));
+            }
+            bp::object dtype = dtypes[keys[i]];
+            columns.push_back(dtype.is_none()
+                ? PyColumn{size_t(col), inferred[col], true}
+                : PyColumn{size_t(col), parse_column_type(bp::extract<std::string>(dtype)), false});
+        }
+    }
+
+    // read everything, then re-read the inferred columns that turned out to
+    // be wider than their sample
+    std::vector<PyColumn*> pending;
+    for(auto& column : columns)
+    {
+        pending.push_back(&column);
+    }
+    while(!pending.empty())
+    {
+        std::vector<csv2::column_output> outputs;
+        for(auto column : pending)
+        {
+            outputs.push_back(column->output(rows));
+        }
+        {
+            ScopedGILRelease nogil;
+            csv2::read_columns(*pSelf, outputs.data(), outputs.size());
+        }
+
+        std::vector<PyColumn*> widen;
+        for(size_t i = 0; i < pending.size(); ++i)
+        {
+            auto& column = *pending[i];
+            const auto& output = outputs[i];
+            const bool integer = column.type == csv2::column_type::integer;
+            if(output.invalid == 0 && !(integer && output.missing > 0))
+            {
+                continue;
+            }
+            if(!column.inferred && integer)
+            {
+                throw std::invalid_argument(std::to_string(output.missing + output.invalid) +
+                                            " cells of column " + std::to_string(column.col) +
+                                            " are not int64");
+            }
+            if(column.inferred)
+            {
+                column.type = integer ? csv2::column_type::floating : csv2::column_type::string;
+                widen.push_back(&column);
+            }
+        }
+        pending.swap(widen);
+    }
+
+    bp::object numpy;
+    try
+    {
+        numpy = bp::import("numpy");
+    }
+    catch(const bp::error_already_set&)
+    {
+        PyErr_Clear();
+    }
+
+    bp::dict result;
+    for(auto& column : columns)
+    {
+        bp::object array;
+        if(column.type == csv2::column_type::string)
+        {
+            array = bp::object{bp::handle<>(PyList_New(rows))};
+            for(size_t r = 0; r < rows; ++r)
+            {
+                PyList_SET_ITEM(array.ptr(), r, to_py_cell(column.strings[r], pSelf->get_quote_ch()));
+            }
+            column.strings = {};
+            if(!numpy.is_none())
+            {
+                array = numpy.attr("array")(array, "object");
+            }
+        }
+        else
+        {
+            const bool integer = column.type == csv2::column_type::integer;
+            if(!numpy.is_none())
+            {
+                array = numpy.attr("frombuffer")(column.buffer, integer ? "int64" : "float64");
+            }
+            else
+            {
+                bp::object view{bp::handle<>(PyMemoryView_FromObject(column.buffer.ptr()))};
+                array = view.attr("cast")(integer ? "q" : "d");
+            }
+        }
+        result[column.col] = array;
+    }
+    return std::move(result);
+}
+
+// {prefix: {"rows": n, "max": [...], "percentile": [...]}} of the display
+// widths over head, tail and strided rows; see csv2::column_widths
+template<typename C>
+bp::dict column_widths_wraper(PyReader<C>* pSelf, size_t head, size_t tail, size_t strided, double percentile)
+{
+    const auto held = lock_buffer(*pSelf);
+    std::map<std::string, csv2::column_width_stats> stats;
+    {
+        ScopedGILRelease nogil;
+        stats = csv2::column_widths(*pSelf, csv2::width_sample_options{head, tail, strided, percentile});
     }
 
-    // f << "row:" << idx << (*LAST_IT).as_string() << std::endl;
-    return *LAST_IT;
+    const auto to_list = [](const std::vector<size_t>& values) {
+        bp::list result;
+        for(auto v : values)
+        {
+            result.append(v);
+        }
+        return result;
+    };
+    bp::dict result;
+    for(const auto& [prefix, s] : stats)
+    {
+        bp::dict entry;
+        entry["rows"] = s.rows;
+        entry["max"] = to_list(s.max);
+        entry["percentile"] = to_list(s.percentile);
+        result[prefix] = entry;
+    }
+    return result;
+}
+
+inline bp::object hit_to_py(const std::optional<csv2::search_hit>& hit)
+{
+    return hit ? bp::make_tuple(hit->row, hit->col) : bp::object();
+}
+
+// (row, col) of the next match of `pattern` from from_row on (or, backward,
+// from from_row back to the first row), None if there is none
+template<typename C>
+bp::object find_wraper(PyReader<C>* pSelf, const std::string& pattern, int64_t from_row, bool backward, bool regex)
+{
+    const auto held = lock_buffer(*pSelf);
+    std::optional<csv2::search_hit> hit;
+    {
+        ScopedGILRelease nogil;
+        pSelf->wait_indexed();
+        if(from_row < 0)
+        {
+            from_row = std::max<int64_t>(from_row + pSelf->size(), 0);
+        }
+        const auto direction = backward ? csv2::search_direction::backward : csv2::search_direction::forward;
+        try
+        {
+            hit = regex ? csv2::find_regex(*pSelf, pattern, from_row, direction)
+                        : csv2::find(*pSelf, pattern, from_row, direction);
+        }
+        catch(const std::regex_error& e)
+        {
+            // rethrown as ValueError once the GIL is back
+            throw std::invalid_argument(std::string("invalid regular expression: ") + e.what());
+        }
+    }
+    return hit_to_py(hit);
+}
+
+template<typename C>
+csv2::Searcher<C>* search_wraper(C* pSelf, const std::string& pattern, bool regex)
+{
+    auto searcher = std::make_unique<csv2::Searcher<C>>();
+    try
+    {
+        searcher->start(*pSelf, pattern, regex);
+    }
+    catch(const std::regex_error& e)
+    {
+        throw std::invalid_argument(std::string("invalid regular expression: ") + e.what());
+    }
+    return searcher.release();
+}
+
+template<typename S>
+bp::object search_next_wraper(const S& self, int64_t from_row, bool backward)
+{
+    return hit_to_py(self.next(std::max<int64_t>(from_row, 0),
+                               backward ? csv2::search_direction::backward : csv2::search_direction::forward));
+}
+
+template<typename S>
+bp::list search_hits_wraper(const S& self, size_t start)
+{
+    bp::list result;
+    for(const auto& hit : self.hits(start))
+    {
+        result.append(bp::make_tuple(hit.row, hit.col));
+    }
+    return result;
+}
+
+template<typename S>
+void search_wait_wraper(const S& self)
+{
+    ScopedGILRelease nogil;
+    self.wait();
+}
+
+template<typename S>
+void search_cancel_wraper(S& self)
+{
+    ScopedGILRelease nogil;
+    self.cancel();
+}
+
+// A Python buffer holding a copy of `values`, as a memoryview of `format`
+template<typename T>
+bp::object to_memoryview(const std::vector<T>& values, const char* format)
+{
+    bp::object buffer{bp::handle<>(PyByteArray_FromStringAndSize(
+        reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T)))};
+    bp::object view{bp::handle<>(PyMemoryView_FromObject(buffer.ptr()))};
+    return view.attr("cast")(format);
+}
+
+// Rows whose cell `col` matches exactly one of equals=, prefix=, in_set= or
+// between=(low, high), as a memoryview of int64 row ids, or with bitmap=True
+// of uint64 words where bit i % 64 of word i / 64 is row i. String bounds
+// select timestamps. Ranges skip blocks through the zone map and values
+// through the Bloom filter, if one is loaded.
+template<typename C>
+bp::object filter_wraper(PyReader<C>* pSelf, int64_t col, bp::object equals, bp::object prefix,
+                         bp::object in_set, bp::object between, bool bitmap)
+{
+    const auto held = lock_buffer(*pSelf);
+    const auto cols = int64_t(pSelf->cols());
+    if(col < 0)
+    {
+        col += cols;
+    }
+    if(col < 0 || col >= cols)
+    {
+        throw std::out_of_range("column index out_of_range " + std::to_string(col));
+    }
+    if(equals.is_none() + prefix.is_none() + in_set.is_none() + between.is_none() != 3)
+    {
+        throw std::invalid_argument("exactly one of equals, prefix, in_set and between is expected");
+    }
+
+    auto test = csv2::predicate::equals("");
+    if(!equals.is_none())
+    {
+        test = csv2::predicate::equals(bp::extract<std::string>(equals));
+    }
+    else if(!prefix.is_none())
+    {
+        test = csv2::predicate::prefix(bp::extract<std::string>(prefix));
+    }
+    else if(!in_set.is_none())
+    {
+        test = csv2::predicate::in_set(std::vector<std::string>(
+            bp::stl_input_iterator<std::string>(in_set), bp::stl_input_iterator<std::string>()));
+    }
+    else if(bp::extract<std::string>(between[0]).check())
+    {
+        double low, high;
+        if(!csv2::parse_timestamp(bp::extract<std::string>(between[0])(), low)
+           || !csv2::parse_timestamp(bp::extract<std::string>(between[1])(), high))
+        {
+            throw std::invalid_argument("between bounds are not timestamps");
+        }
+        test = csv2::predicate::time_between(low, high);
+    }
+    else
+    {
+        test = csv2::predicate::between(bp::extract<double>(between[0]), bp::extract<double>(between[1]));
+    }
+    const bool ranged = test.type() == csv2::predicate::kind::between
+                        || test.type() == csv2::predicate::kind::time_between;
+    const auto zones = ranged ? pSelf->zones : nullptr;
+    const auto bloom = ranged ? nullptr : pSelf->bloom;
+
+    if(bitmap)
+    {
+        std::vector<uint64_t> words;
+        {
+            ScopedGILRelease nogil;
+            pSelf->wait_indexed();
+            words = zones ? csv2::filter_bitmap(*pSelf, col, test, *zones)
+                  : bloom ? csv2::filter_bitmap(*pSelf, col, test, *bloom)
+                          : csv2::filter_bitmap(*pSelf, col, test);
+        }
+        return to_memoryview(words, "Q");
+    }
+    std::vector<size_t> rows;
+    {
+        ScopedGILRelease nogil;
+        pSelf->wait_indexed();
+        rows = zones ? csv2::filter_rows(*pSelf, col, test, *zones)
+             : bloom ? csv2::filter_rows(*pSelf, col, test, *bloom)
+                     : csv2::filter_rows(*pSelf, col, test);
+    }
+    static_assert(sizeof(size_t) == sizeof(int64_t), "row ids are exported as int64");
+    return to_memoryview(rows, "q");
+}
+
+// Rows [first, last) of a column sorted ascending whose cell compares equal
+// to `key`, by binary search. `order` is "number", "timestamp" or "text";
+// by default numbers compare as numbers and strings as text.
+template<typename C>
+std::pair<size_t, size_t> sorted_range(PyReader<C>* pSelf, int64_t col, bp::object key, bp::object order,
+                                       bool lower, bool upper)
+{
+    const auto held = lock_buffer(*pSelf);
+    const auto cols = int64_t(pSelf->cols());
+    if(col < 0)
+    {
+        col += cols;
+    }
+    if(col < 0 || col >= cols)
+    {
+        throw std::out_of_range("column index out_of_range " + std::to_string(col));
+    }
+    bp::extract<std::string> text(key);
+    auto keyOrder = text.check() ? csv2::key_order::text : csv2::key_order::number;
+    if(!order.is_none())
+    {
+        const std::string name = bp::extract<std::string>(order);
+        if(name == "number")
+            keyOrder = csv2::key_order::number;
+        else if(name == "timestamp")
+            keyOrder = csv2::key_order::timestamp;
+        else if(name == "text")
+            keyOrder = csv2::key_order::text;
+        else
+            throw std::invalid_argument("unknown key order " + name);
+    }
+    std::optional<csv2::detail::sort_key> sortKey;
+    if(text.check())
+        sortKey.emplace(std::string_view(text()), keyOrder);
+    else
+        sortKey.emplace(double(bp::extract<double>(key)), keyOrder);
+
+    ScopedGILRelease nogil;
+    pSelf->wait_indexed();
+    std::pair<size_t, size_t> result{0, 0};
+    if(lower)
+        result.first = csv2::detail::partition_rows(*pSelf, col, *sortKey, false);
+    if(upper)
+        result.second = csv2::detail::partition_rows(*pSelf, col, *sortKey, true);
+    return result;
+}
+
+template<typename C>
+size_t lower_bound_wraper(PyReader<C>* pSelf, int64_t col, bp::object key, bp::object order)
+{
+    return sorted_range(pSelf, col, key, order, true, false).first;
+}
+
+template<typename C>
+size_t upper_bound_wraper(PyReader<C>* pSelf, int64_t col, bp::object key, bp::object order)
+{
+    return sorted_range(pSelf, col, key, order, false, true).second;
+}
+
+template<typename C>
+bp::tuple equal_range_wraper(PyReader<C>* pSelf, int64_t col, bp::object key, bp::object order)
+{
+    const auto range = sorted_range(pSelf, col, key, order, true, true);
+    return bp::make_tuple(range.first, range.second);
+}
+
+template<typename C>
+bool build_zone_map_wraper(PyReader<C>& self, size_t block_rows)
+{
+    const auto held = lock_buffer(self);
+    auto zones = std::make_shared<csv2::ZoneMap>();
+    bool built;
+    {
+        ScopedGILRelease nogil;
+        self.wait_indexed();
+        built = zones->build(self, block_rows);
+    }
+    self.zones = built ? std::move(zones) : nullptr;
+    return built;
+}
+
+// An empty path means the sidecar next to the mapped file
+template<typename C>
+std::string zone_map_path(const PyReader<C>& self, const std::string& path)
+{
+    return path.empty() ? csv2::ZoneMap::sidecar_path(self.path) : path;
+}
+
+template<typename C>
+bool save_zone_map_wraper(PyReader<C>& self, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    return self.zones && self.zones->save(zone_map_path(self, path));
+}
+
+template<typename C>
+bool load_zone_map_wraper(PyReader<C>& self, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    auto zones = std::make_shared<csv2::ZoneMap>();
+    bool loaded;
+    {
+        ScopedGILRelease nogil;
+        loaded = zones->load(zone_map_path(self, path), csv2::file_stamp::of_reader(self));
+    }
+    if(loaded)
+    {
+        self.zones = std::move(zones);
+    }
+    return loaded;
+}
+
+template<typename C>
+bool build_bloom_filter_wraper(PyReader<C>& self, bp::object columns, size_t block_rows,
+                               double bits_per_value)
+{
+    const auto held = lock_buffer(self);
+    std::vector<size_t> cols(bp::stl_input_iterator<size_t>(columns), bp::stl_input_iterator<size_t>{});
+    auto bloom = std::make_shared<csv2::BloomFilter>();
+    bool built;
+    {
+        ScopedGILRelease nogil;
+        self.wait_indexed();
+        built = bloom->build(self, std::move(cols), block_rows, bits_per_value);
+    }
+    self.bloom = built ? std::move(bloom) : nullptr;
+    return built;
+}
+
+template<typename C>
+bool save_bloom_filter_wraper(PyReader<C>& self, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    return self.bloom && self.bloom->save(path.empty() ? csv2::BloomFilter::sidecar_path(self.path) : path);
+}
+
+template<typename C>
+bool load_bloom_filter_wraper(PyReader<C>& self, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    auto bloom = std::make_shared<csv2::BloomFilter>();
+    bool loaded;
+    {
+        ScopedGILRelease nogil;
+        loaded = bloom->load(path.empty() ? csv2::BloomFilter::sidecar_path(self.path) : path,
+                             csv2::file_stamp::of_reader(self));
+    }
+    if(loaded)
+    {
+        self.bloom = std::move(bloom);
+    }
+    return loaded;
+}
+
+// Whether `value` may be in column `col`; true without a Bloom filter
+template<typename C>
+bool may_contain_wraper(PyReader<C>& self, size_t col, const std::string& value)
+{
+    const auto held = lock_buffer(self);
+    return !self.bloom || self.bloom->may_contain(col, value);
+}
+
+// A column given by index (negative counts from the end) or by the name in a
+// header row
+template<typename C>
+size_t column_index(const C& self, bp::object col)
+{
+    bp::extract<std::string> name(col);
+    if(name.check())
+    {
+        for(const auto& header : self.header())
+        {
+            for(const auto cell : header)
+            {
+                if(csv2::detail::strip_cell(cell.raw_view(), self.get_quote_ch()) == name())
+                {
+                    return cell.cell_no();
+                }
+            }
+        }
+        throw std::out_of_range("no column named " + name());
+    }
+    const auto cols = int64_t(self.cols());
+    int64_t index = bp::extract<int64_t>(col);
+    if(index < 0)
+    {
+        index += cols;
+    }
+    if(index < 0 || index >= cols)
+    {
+        throw std::out_of_range("column index out_of_range " + std::to_string(index));
+    }
+    return size_t(index);
+}
+
+template<typename C>
+bool build_hash_index_wraper(PyReader<C>& self, bp::object col, size_t threads)
+{
+    const auto held = lock_buffer(self);
+    const auto index = column_index(self, col);
+    auto hash = std::make_shared<csv2::HashIndex>();
+    bool built;
+    {
+        ScopedGILRelease nogil;
+        self.wait_indexed();
+        built = hash->build(self, index, threads);
+    }
+    if(built)
+    {
+        self.hash_indexes[index] = std::move(hash);
+    }
+    return built;
+}
+
+template<typename C>
+bool save_hash_index_wraper(PyReader<C>& self, bp::object col, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    const auto index = column_index(self, col);
+    const auto found = self.hash_indexes.find(index);
+    return found != self.hash_indexes.end()
+        && found->second->save(path.empty() ? csv2::HashIndex::sidecar_path(self.path, index) : path);
+}
+
+template<typename C>
+bool load_hash_index_wraper(PyReader<C>& self, bp::object col, const std::string& path)
+{
+    const auto held = lock_buffer(self);
+    const auto index = column_index(self, col);
+    auto hash = std::make_shared<csv2::HashIndex>();
+    bool loaded;
+    {
+        ScopedGILRelease nogil;
+        loaded = hash->load(path.empty() ? csv2::HashIndex::sidecar_path(self.path, index) : path,
+                            csv2::file_stamp::of_reader(self))
+            && hash->col() == index;
+    }
+    if(loaded)
+    {
+        self.hash_indexes[index] = std::move(hash);
+    }
+    return loaded;
+}
+
+// Data rows whose cell in `col` equals `value`, through the column's hash
+// index if one is loaded, scanning the column otherwise; `first` stops at
+// the first of them
+template<typename C>
+std::vector<size_t> lookup_rows(PyReader<C>& self, bp::object col, const std::string& value, bool first)
+{
+    const auto held = lock_buffer(self);
+    const auto index = column_index(self, col);
+    const auto found = self.hash_indexes.find(index);
+    const auto hash = found == self.hash_indexes.end() ? nullptr : found->second;
+
+    ScopedGILRelease nogil;
+    self.wait_indexed();
+    if(hash)
+    {
+        if(!first)
+            return hash->find_rows(self, value);
+        const auto row = hash->find_row(self, value);
+        return row ? std::vector<size_t>{*row} : std::vector<size_t>{};
+    }
+    std::vector<size_t> rows;
+    auto it = self.begin();
+    for(size_t irow = 0; irow < self.size() && !(first && !rows.empty()); ++irow, ++it)
+    {
+        if(csv2::detail::strip_cell(csv2::cell_view(*it, index), self.get_quote_ch()) == value)
+            rows.push_back(irow);
+    }
+    return rows;
+}
+
+// The first data row whose cell in `col` equals `value`, or None
+template<typename C>
+bp::object find_row_wraper(PyReader<C>& self, bp::object col, const std::string& value)
+{
+    const auto rows = lookup_rows(self, col, value, true);
+    return rows.empty() ? bp::object() : bp::object(rows.front());
+}
+
+template<typename C>
+bp::list find_rows_wraper(PyReader<C>& self, bp::object col, const std::string& value)
+{
+    bp::list result;
+    for(const auto row : lookup_rows(self, col, value, false))
+    {
+        result.append(row);
+    }
+    return result;
+}
+
+// {(key, ...): (value, ...)} grouping the rows by the `keys` columns, in the
+// order the groups first appear. Each aggregate is "count" or a tuple
+// (op, col) with op "count", "sum", "min", "max" or "mean"; columns are
+// indices or header names.
+template<typename C>
+bp::dict group_by_wraper(PyReader<C>& self, bp::object keys, bp::object aggregates, size_t threads)
+{
+    const auto held = lock_buffer(self);
+    std::vector<size_t> keyCols;
+    for(bp::stl_input_iterator<bp::object> it(keys), end; it != end; ++it)
+    {
+        keyCols.push_back(column_index(self, *it));
+    }
+    std::vector<csv2::aggregate> aggs;
+    for(bp::stl_input_iterator<bp::object> it(aggregates), end; it != end; ++it)
+    {
+        bp::object spec = *it;
+        bp::extract<std::string> name(spec);
+        const std::string op = name.check() ? name() : bp::extract<std::string>(spec[0])();
+        csv2::aggregate a{csv2::aggregate_op::count, 0};
+        if(op == "sum")
+            a.op = csv2::aggregate_op::sum;
+        else if(op == "min")
+            a.op = csv2::aggregate_op::min;
+        else if(op == "max")
+            a.op = csv2::aggregate_op::max;
+        else if(op == "mean")
+            a.op = csv2::aggregate_op::mean;
+        else if(op != "count")
+            throw std::invalid_argument("unknown aggregate " + op);
+        if(a.op != csv2::aggregate_op::count)
+        {
+            if(name.check())
+                throw std::invalid_argument(op + " needs a column: (\"" + op + "\", col)");
+            a.col = column_index(self, spec[1]);
+        }
+        aggs.push_back(a);
+    }
+
+    std::vector<csv2::group> groups;
+    {
+        ScopedGILRelease nogil;
+        self.wait_indexed();
+        csv2::group_by_options options;
+        options.threads = threads;
+        groups = csv2::group_by(self, keyCols, aggs, options);
+    }
+    bp::dict result;
+    for(const auto& g : groups)
+    {
+        bp::list key, values;
+        for(const auto k : g.keys)
+            key.append(bp::str(k.data(), k.size()));
+        for(const auto v : g.values)
+            values.append(v);
+        result[bp::tuple(key)] = bp::tuple(values);
+    }
+    return result;
+}
+
+// Checks the Bloom filter sidecar of a file without indexing it; true when
+// the file has no sidecar built for its current contents
+bool file_may_contain(const std::string& filename, size_t col, const std::string& value)
+{
+    ScopedGILRelease nogil;
+    csv2::BloomFilter bloom;
+    return !bloom.load(csv2::BloomFilter::sidecar_path(filename), csv2::file_stamp::of(filename))
+        || bloom.may_contain(col, value);
+}
+
+// Row ranges [first, last) that may hold a value of column `col` between
+// low and high (numbers, or timestamps as strings); all rows without a zone map
+template<typename C>
+bp::list zone_ranges_wraper(PyReader<C>& self, size_t col, bp::object low, bp::object high)
+{
+    const auto held = lock_buffer(self);
+    double bounds[2];
+    bp::object given[2] = {low, high};
+    for(int i = 0; i < 2; ++i)
+    {
+        bp::extract<std::string> text(given[i]);
+        if(!text.check())
+        {
+            bounds[i] = bp::extract<double>(given[i]);
+        }
+        else if(!csv2::parse_timestamp(text(), bounds[i]))
+        {
+            throw std::invalid_argument("bound is not a timestamp: " + text());
+        }
+    }
+    bp::list result;
+    if(!self.zones)
+    {
+        result.append(bp::make_tuple(0, self.size()));
+        return result;
+    }
+    for(const auto& [first, last] : self.zones->row_ranges(col, bounds[0], bounds[1]))
+    {
+        result.append(bp::make_tuple(first, last));
+    }
+    return result;
 }
 
 template <class delimiter = delimiter<','>, class quote_character = quote_character<'"'>,
@@ -137,7 +1284,7 @@ void export_reader(const std::string& name
     using CSVT = csv2::Reader<delimiter, quote_character, first_row_is_header, trim_policy>;
     using CellT = typename CSVT::Cell;
     using RowT = typename CSVT::Row;
-    using RowRangeT = RowRange<typename CSVT::RowIterator>;
+    using RowSliceT = RowSlice<CSVT>;
     using RowIterT = typename CSVT::RowIterator;
 
     auto cellName = name+"Cell";
@@ -147,16 +1294,18 @@ void export_reader(const std::string& name
         .def("__str__", to_string_wraper<CellT>);
 
     auto rowName = name+"Row"; 
-    bp::class_<RowT>(rowName.c_str())
+    bp::class_<RowT, PyRow<RowT>>(rowName.c_str())
         .def("__iter__", bp::iterator<RowT>())
         .def("line_no", &RowT::line_no)
         .def("__str__", to_string_wraper<RowT>)
         .def("__len__", &RowT::cols)
         .def("__getitem__", get_cell_wraper<RowT>);
     
-    auto rowRange = name+"RowRange";
-    bp::class_<RowRangeT>(rowRange.c_str(), bp::no_init)
-        .def("__iter__", bp::iterator<RowRangeT>());
+    auto rowSlice = name+"RowSlice";
+    bp::class_<RowSliceT>(rowSlice.c_str(), bp::no_init)
+        .def("__len__", &RowSliceT::size)
+        .def("__iter__", bp::iterator<RowSliceT>())
+        .def("__getitem__", get_slice_row_wraper<CSVT>);
 
     using RowVec = std::vector<RowT>;
     auto rowVecName = name+"RowVec";
@@ -169,8 +1318,24 @@ void export_reader(const std::string& name
         .def("prev", &RowIterT::operator-=, bp::return_self<>())
         .def("get", &RowIterT::operator*);
 
-    bp::class_<CSVT, boost::noncopyable>(name.c_str())
+    using SearcherT = csv2::Searcher<CSVT>;
+    auto searchName = name+"Search";
+    bp::class_<SearcherT, boost::noncopyable>(searchName.c_str(), bp::no_init)
+        .def("done", &SearcherT::done)
+        .def("progress", &SearcherT::progress)
+        .def("hits_so_far", &SearcherT::hits_so_far)
+        .def("hits", search_hits_wraper<SearcherT>, (bp::arg("start")=0))
+        .def("next", search_next_wraper<SearcherT>, (bp::arg("from_row"), bp::arg("backward")=false))
+        .def("wait", search_wait_wraper<SearcherT>)
+        .def("cancel", search_cancel_wraper<SearcherT>);
+
+    bp::class_<CSVT, PyReader<CSVT>, boost::noncopyable>(name.c_str())
         .def("mmap", mmap_wraper<CSVT>)
+        .def("mmap_async", mmap_async_wraper<CSVT>)
+        .def("indexing_done", &CSVT::indexing_done)
+        .def("rows_indexed_so_far", &CSVT::rows_indexed_so_far)
+        .def("indexing_progress", &CSVT::indexing_progress)
+        .def("wait_indexed", wait_indexed_wraper<CSVT>)
         .def("header", &CSVT::header, bp::return_internal_reference<>())
         .def("cols", &CSVT::cols)
         .def("rows", &CSVT::rows)
@@ -179,14 +1344,52 @@ void export_reader(const std::string& name
         .def("get_iter", &CSVT::operator())
         .def("get_delimiter", &CSVT::get_delimiter)
         .def("get_quote_ch", &CSVT::get_quote_ch)
+        .def("read_column", read_column_wraper<CSVT>, (bp::arg("idx"), bp::arg("dtype")="float64"))
+        .def("to_dict_of_arrays", to_dict_of_arrays_wraper<CSVT>, (bp::arg("schema")=bp::object()))
+        .def("column_widths", column_widths_wraper<CSVT>,
+             (bp::arg("head")=1000, bp::arg("tail")=1000, bp::arg("strided")=1000,
+              bp::arg("percentile")=0.95))
+        .def("filter", filter_wraper<CSVT>, (bp::arg("col"), bp::arg("equals")=bp::object(),
+                                             bp::arg("prefix")=bp::object(), bp::arg("in_set")=bp::object(),
+                                             bp::arg("between")=bp::object(), bp::arg("bitmap")=false))
+        .def("lower_bound", lower_bound_wraper<CSVT>,
+             (bp::arg("col"), bp::arg("key"), bp::arg("order")=bp::object()))
+        .def("upper_bound", upper_bound_wraper<CSVT>,
+             (bp::arg("col"), bp::arg("key"), bp::arg("order")=bp::object()))
+        .def("equal_range", equal_range_wraper<CSVT>,
+             (bp::arg("col"), bp::arg("key"), bp::arg("order")=bp::object()))
+        .def("build_bloom_filter", build_bloom_filter_wraper<CSVT>,
+             (bp::arg("columns"), bp::arg("block_rows")=65536, bp::arg("bits_per_value")=10.0))
+        .def("save_bloom_filter", save_bloom_filter_wraper<CSVT>, (bp::arg("path")=""))
+        .def("load_bloom_filter", load_bloom_filter_wraper<CSVT>, (bp::arg("path")=""))
+        .def("may_contain", may_contain_wraper<CSVT>, (bp::arg("col"), bp::arg("value")))
+        .def("build_hash_index", build_hash_index_wraper<CSVT>, (bp::arg("col"), bp::arg("threads")=0))
+        .def("save_hash_index", save_hash_index_wraper<CSVT>, (bp::arg("col"), bp::arg("path")=""))
+        .def("load_hash_index", load_hash_index_wraper<CSVT>, (bp::arg("col"), bp::arg("path")=""))
+        .def("find_row", find_row_wraper<CSVT>, (bp::arg("col"), bp::arg("value")))
+        .def("find_rows", find_rows_wraper<CSVT>, (bp::arg("col"), bp::arg("value")))
+        .def("group_by", group_by_wraper<CSVT>,
+             (bp::arg("keys"), bp::arg("aggregates"), bp::arg("threads")=0))
+        .def("build_zone_map", build_zone_map_wraper<CSVT>, (bp::arg("block_rows")=65536))
+        .def("save_zone_map", save_zone_map_wraper<CSVT>, (bp::arg("path")=""))
+        .def("load_zone_map", load_zone_map_wraper<CSVT>, (bp::arg("path")=""))
+        .def("zone_ranges", zone_ranges_wraper<CSVT>, (bp::arg("col"), bp::arg("low"), bp::arg("high")))
+        .def("find", find_wraper<CSVT>, (bp::arg("pattern"), bp::arg("from_row")=0,
+                                         bp::arg("backward")=false, bp::arg("regex")=false))
+        .def("search", search_wraper<CSVT>, (bp::arg("pattern"), bp::arg("regex")=false),
+             bp::return_value_policy<bp::manage_new_object, bp::with_custodian_and_ward_postcall<0, 1>>())
+        .def("fetch", fetch_wraper<CSVT>, (bp::arg("start"), bp::arg("stop"),
+                                           bp::arg("columns")=bp::object(), bp::arg("as_dict")=false))
         .def("__len__", &CSVT::size)
         .def("__iter__", bp::iterator<CSVT>())
-        .def("__getitem__", get_slice_wraper<CSVT>)
+        .def("__getitem__", get_slice_wraper<CSVT>, bp::with_custodian_and_ward_postcall<0, 1>())
         .def("__getitem__", get_row_wraper<CSVT>);
 }
 
 BOOST_PYTHON_MODULE(libpycsv2)
 {
+    bp::def("may_contain", file_may_contain, (bp::arg("path"), bp::arg("col"), bp::arg("value")));
+
     csv2::CommaHeaderCSV chc;
     export_reader("CommaHeaderCSV", chc);
 
@@ -1,10 +1,52 @@
 #include "doctest.hpp"
+#include <csv2/aggregate.hpp>
+#include <csv2/block_reader.hpp>
+#include <csv2/bloom_filter.hpp>
+#include <csv2/column.hpp>
+#include <csv2/compressed_index.hpp>
+#include <csv2/compressed_reader.hpp>
+#include <csv2/filter.hpp>
+#include <csv2/hash_index.hpp>
+#include <csv2/parallel_writer.hpp>
 #include <csv2/reader.hpp>
+#include <csv2/search.hpp>
+#include <csv2/sorted.hpp>
+#include <csv2/transcoder.hpp>
+#include <csv2/writer.hpp>
+#include <csv2/zone_map.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 using namespace csv2;
 using doctest::test_suite;
 
+// Overwrites `file` without replacing it (same inode and size) and moves its
+// modification time a second on, past the granularity of the clock
+static void rewrite_in_place(const std::string &file, const std::string &contents) {
+  const auto modified = std::filesystem::last_write_time(file);
+  std::ofstream(file, std::ios::binary | std::ios::in) << contents;
+  std::filesystem::last_write_time(file, modified + std::chrono::seconds(1));
+}
+
+// A copy of a sidecar with the 64-bit field at `offset` set to `value`
+static std::string patch_sidecar(const std::string &path, std::streamoff offset, uint64_t value) {
+  const std::string corrupt = path + ".corrupt";
+  {
+    std::ifstream original(path, std::ios::binary);
+    std::ofstream(corrupt, std::ios::binary) << original.rdbuf();
+  }
+  std::fstream sidecar(corrupt, std::ios::in | std::ios::out | std::ios::binary);
+  sidecar.seekp(offset);
+  sidecar.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  return corrupt;
+}
+
 TEST_CASE("Parse an empty CSV" * test_suite("Reader")) {
   Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<false>> csv;
   bool exception_thrown{false};
@@ -321,6 +363,141 @@ TEST_CASE("Parse the most basic of CSV buffers from string" * test_suite("Reader
   REQUIRE(cols == 3);
 }
 
+TEST_CASE("Parse from string initializes header and shape" * test_suite("Reader")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  const std::string_view buffer = "a,b,c\n1,2,3\n4,5,6";
+  REQUIRE(csv.parse(buffer));
+  REQUIRE(csv.rows() == 3);
+  REQUIRE(csv.cols() == 3);
+  REQUIRE(csv.size() == 2);
+  REQUIRE(csv.header().size() == 1);
+  REQUIRE(csv.header()[0].as_string() == "a,b,c");
+  REQUIRE(csv[1].as_string() == "4,5,6");
+
+  size_t rows{0};
+  for (auto row : csv) {
+    (void)(row);
+    rows += 1;
+  }
+  REQUIRE(rows == 2);
+}
+
+TEST_CASE("Parse from an owned buffer" * test_suite("Reader")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string("a,b,c\n1,2,3\n")));
+  REQUIRE(csv.size() == 1);
+  REQUIRE(csv[0].as_string() == "1,2,3");
+
+  const std::string contents = "x,y\n7,8\n9,10\n";
+  std::unique_ptr<char[]> buffer(new char[contents.size()]);
+  memcpy(buffer.get(), contents.data(), contents.size());
+  REQUIRE(csv.parse(std::move(buffer), contents.size()));
+  REQUIRE(csv.cols() == 2);
+  REQUIRE(csv.size() == 2);
+  REQUIRE(csv[1].as_string() == "9,10");
+}
+
+TEST_CASE("Random access through the row index" * test_suite("Reader")) {
+  // enough rows for several index entries, last row unterminated
+  std::string contents = "h1,h2\n";
+  const size_t n = Reader<>::row_index_stride * 5 + 3;
+  for (size_t i = 0; i < n; ++i)
+    contents += std::to_string(i) + "," + (i % 7 ? "x" : "") + (i + 1 < n ? "\n" : "");
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+  REQUIRE(csv.size() == n);
+
+  size_t i = 0;
+  for (const auto row : csv) {
+    auto it = csv(i);
+    REQUIRE((*it).as_string() == row.as_string());
+    REQUIRE(it.line_no() == int64_t(i));
+    ++i;
+  }
+  REQUIRE(csv[n - 1].as_string() == std::to_string(n - 1) + ((n - 1) % 7 ? ",x" : ","));
+  REQUIRE(csv(n) == csv.end());
+  REQUIRE(csv(n + 10) == csv.end());
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<false>> no_header;
+  REQUIRE(no_header.parse(std::string_view(contents)));
+  REQUIRE(no_header[0].as_string() == "h1,h2");
+  REQUIRE(no_header[Reader<>::row_index_stride].as_string() ==
+          std::to_string(Reader<>::row_index_stride - 1) + ",x");
+
+  // no buffer, no index: never mapped, or the mapping failed
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> empty;
+  REQUIRE(empty(0) == empty.end());
+  REQUIRE(empty[0].as_string().empty());
+  REQUIRE(empty.mmap_async("inputs/test_01.csv"));
+  REQUIRE_THROWS(empty.mmap("inputs/no_such_file.csv"));
+  REQUIRE(empty.buffer() == nullptr);
+  REQUIRE(empty(0) == empty.end());
+  REQUIRE(empty[0].as_string().empty());
+}
+
+TEST_CASE("Index rows on a background thread" * test_suite("Reader")) {
+  // several indexing slices, last row unterminated
+  const std::string file = "async_index.csv";
+  {
+    std::ofstream out(file, std::ios::binary);
+    out << "id,name\n";
+    for (size_t i = 0; i < 2000000; ++i)
+      out << i << ",row" << i << (i + 1 < 2000000 ? "\n" : "");
+  }
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> sync;
+  REQUIRE(sync.mmap(file));
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap_async(file));
+  REQUIRE(csv.cols() == 2);
+  REQUIRE(csv.header().size() == 1);
+  size_t seen = 0;
+  while (!csv.indexing_done()) {
+    const auto n = csv.rows_indexed_so_far();
+    REQUIRE(n >= seen);
+    if (n > 0)
+      REQUIRE(csv[n - 1].as_string() == sync[n - 1].as_string());
+    seen = n;
+  }
+  csv.wait_indexed();
+  REQUIRE(csv.indexing_progress() == 1.0);
+  REQUIRE(csv.rows() == sync.rows());
+  REQUIRE(csv.size() == 2000000);
+  REQUIRE(csv[1999999].as_string() == "1999999,row1999999");
+
+  // readers move, also while they index: out of a factory, within a
+  // growing vector, and over a reader that is itself still indexing
+  auto open_async = [&] {
+    decltype(csv) reader;
+    REQUIRE(reader.mmap_async(file));
+    return reader;
+  };
+  std::vector<decltype(csv)> readers;
+  for (int i = 0; i < 3; ++i)
+    readers.push_back(open_async());
+  readers[0] = open_async();
+  readers.push_back(std::move(readers[1]));
+  readers.push_back(std::move(csv));
+  REQUIRE(readers[1].buffer() == nullptr);
+  REQUIRE(csv.buffer() == nullptr);
+  for (auto &reader : readers) {
+    if (reader.buffer() == nullptr)
+      continue;
+    reader.wait_indexed();
+    REQUIRE(reader.size() == 2000000);
+    REQUIRE(reader[1999999].as_string() == "1999999,row1999999");
+    REQUIRE(reader[1000000].as_string() == sync[1000000].as_string());
+  }
+
+  // a new file while the previous one is still being indexed
+  REQUIRE(csv.mmap_async(file));
+  REQUIRE(csv.parse(std::string_view("a,b\n1,2\n")));
+  REQUIRE(csv.size() == 1);
+  std::remove(file.c_str());
+}
+
 TEST_CASE("Parse the most basic of CSV buffers with whitespace trimming enabled" *
           test_suite("Reader")) {
   Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<false>> csv;
@@ -384,4 +561,1007 @@ TEST_CASE("Parse the most basic of CSV buffers with double quotes with just deli
   size_t cols = cells / rows;
   REQUIRE(rows == 1);
   REQUIRE(cols == 6);
-}
\ No newline at end of file
+}
+TEST_CASE("Prefetch ahead of the row iterator" * test_suite("Reader")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap("inputs/test_12_unix.csv"));
+  REQUIRE(csv.enable_prefetch(4096));
+  REQUIRE(csv.prefetcher() != nullptr);
+
+  const std::vector<std::string> expected_cells{"1", "2", "3", "4", "5", "6"};
+
+  size_t rows{0}, cells{0};
+  for (auto row : csv) {
+    rows += 1;
+    for (auto cell : row) {
+      std::string value;
+      cell.read_value(value);
+      REQUIRE(value == expected_cells[cells++]);
+    }
+  }
+  REQUIRE(rows == 2);
+  csv.disable_prefetch();
+  REQUIRE(csv.prefetcher() == nullptr);
+}
+
+TEST_CASE("Switch prefetching on and off during a scan" * test_suite("Reader")) {
+  const std::string file = "prefetch_test.csv";
+  {
+    std::ofstream out(file, std::ios::binary);
+    out << "id,payload\n";
+    for (size_t i = 0; i < 40000; ++i)
+      out << i << "," << std::string(100, char('a' + i % 26)) << "\n";
+  }
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap(file));
+  REQUIRE(csv.size() == 40000);
+  REQUIRE(csv.enable_prefetch(64 * 1024, prefetch_policy::touch));
+
+  // the thread follows the iterator; rows are over 100 bytes long
+  const auto prefetched_past = [&](size_t offset) {
+    for (int i = 0; i < 2000 && csv.prefetcher()->prefetched() < offset; ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return csv.prefetcher()->prefetched() >= offset;
+  };
+  REQUIRE(prefetched_past(64 * 1024));
+
+  size_t rows{0};
+  bool ids_match = true;
+  for (auto it = csv.begin(); it != csv.end(); ++it, ++rows) {
+    ids_match = ids_match && (*(*it).begin()).raw_view() == std::to_string(rows);
+    if (rows == 10000) {
+      REQUIRE(prefetched_past(10000 * 100 + 64 * 1024));
+      csv.disable_prefetch(); // the iterator keeps reporting to the reader
+    } else if (rows == 20000) {
+      REQUIRE(csv.enable_prefetch(64 * 1024, prefetch_policy::advise));
+    } else if (rows == 30000) {
+      REQUIRE(prefetched_past(30000 * 100 + 64 * 1024));
+      REQUIRE(csv.enable_prefetch(128 * 1024));
+    }
+  }
+  REQUIRE(ids_match);
+  REQUIRE(rows == 40000);
+  REQUIRE(prefetched_past(csv.buffer_size()));
+  csv.disable_prefetch();
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Stream a file through the block reader" * test_suite("BlockReader")) {
+  for (bool io_uring : {true, false}) {
+    BlockReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    block_reader_options options;
+    options.block_size = 4096;
+    options.io_uring = io_uring;
+    REQUIRE(csv.open("inputs/test_12_unix.csv", options));
+    REQUIRE(csv.cols() == 3);
+
+    const std::vector<std::string> expected_cells{"1", "2", "3", "4", "5", "6"};
+
+    size_t rows{0}, cells{0};
+    for (auto row : csv) {
+      rows += 1;
+      for (auto cell : row) {
+        std::string value;
+        cell.read_value(value);
+        REQUIRE(value == expected_cells[cells++]);
+      }
+    }
+    REQUIRE(rows == 2);
+  }
+}
+
+TEST_CASE("Stream rows across block boundaries" * test_suite("BlockReader")) {
+  // short rows, rows longer than a block and than the carry area, and quoted
+  // newlines on the last byte of a block and on the first byte of the next
+  const size_t block = 4096;
+  std::string contents = "id,text,n\n";
+  uint32_t seed = 1;
+  for (size_t i = 0; contents.size() < 300 * block; ++i) {
+    seed = seed * 1103515245 + 12345;
+    std::string row;
+    const std::string prefix = std::to_string(i) + ",\"";
+    const size_t newline_at = (contents.size() / block + 1) * block - 1 + i % 2;
+    if (i % 20 == 7 && contents.size() + prefix.size() < newline_at)
+      row = prefix + std::string(newline_at - contents.size() - prefix.size(), 'q') + "\ntail\",1\n";
+    else
+      row = std::to_string(i) + "," +
+            std::string(i % 97 == 0 ? 3 * block + seed % block : seed % 200, char('a' + i % 26)) +
+            "," + std::to_string(seed % 1000) + "\n";
+    contents += row;
+  }
+  contents += "last,row,unterminated";
+  const std::string file = "block_reader_test.csv";
+  std::ofstream(file, std::ios::binary) << contents;
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> mapped;
+  REQUIRE(mapped.mmap(file));
+  std::vector<std::string_view> expected;
+  for (const auto row : mapped)
+    expected.push_back(row.as_string());
+  REQUIRE(expected.size() > 1000);
+
+  for (bool io_uring : {true, false}) {
+    BlockReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    block_reader_options options;
+    options.block_size = block;
+    options.carry_capacity = block;
+    options.queue_depth = 3;
+    options.io_uring = io_uring;
+    REQUIRE(csv.open(file, options));
+    REQUIRE(csv.cols() == 3);
+
+    size_t rows{0};
+    bool rows_match = true;
+    for (const auto row : csv) {
+      rows_match = rows_match && rows < expected.size() && row.as_string() == expected[rows];
+      ++rows;
+    }
+    REQUIRE(rows_match);
+    REQUIRE(rows == expected.size());
+    REQUIRE(csv.error() == 0);
+  }
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Detect and decompress compressed input" * test_suite("CompressedReader")) {
+  std::vector<std::string> files{"inputs/test_12_unix.csv"};
+#ifdef CSV2_WITH_ZLIB
+  files.push_back("inputs/test_12_unix.csv.gz");
+#endif
+  for (const auto &file : files) {
+    CompressedReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    REQUIRE(csv.open(file));
+    REQUIRE(csv.cols() == 3);
+
+    const std::vector<std::string> expected_cells{"1", "2", "3", "4", "5", "6"};
+
+    size_t rows{0}, cells{0};
+    for (auto row : csv) {
+      rows += 1;
+      for (auto cell : row) {
+        std::string value;
+        cell.read_value(value);
+        REQUIRE(value == expected_cells[cells++]);
+      }
+    }
+    REQUIRE(rows == 2);
+    REQUIRE(csv.error() == 0);
+  }
+}
+
+#ifdef CSV2_WITH_ZLIB
+// One gzip member holding `text`
+static std::string gzip_member(std::string_view text, int level = 6) {
+  z_stream stream{};
+  REQUIRE(deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  std::string result(deflateBound(&stream, static_cast<uLong>(text.size())), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  stream.avail_in = static_cast<uInt>(text.size());
+  stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+  stream.avail_out = static_cast<uInt>(result.size());
+  REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  result.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result;
+}
+#endif
+
+TEST_CASE("Decompress input spanning many chunks, members and frames" * test_suite("CompressedReader")) {
+  std::string contents = "id,name,value\n";
+  for (size_t i = 0; i < 100000; ++i)
+    contents += std::to_string(i) + ",name" + std::to_string(i % 37) + "," + std::to_string(i * 7 % 1000) + "\n";
+  // three parts split inside rows, so rows straddle members and frames
+  const size_t splits[] = {0, contents.size() / 3 + 5, contents.size() * 2 / 3 + 11, contents.size()};
+  std::vector<std::string_view> parts;
+  for (size_t k = 0; k < 3; ++k)
+    parts.push_back(std::string_view(contents).substr(splits[k], splits[k + 1] - splits[k]));
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> plain;
+  REQUIRE(plain.parse(std::string_view(contents)));
+  std::vector<std::string_view> expected;
+  for (const auto row : plain)
+    expected.push_back(row.as_string());
+
+  // rows read through `options` match the plain ones; returns the frames decoded in parallel
+  const auto read = [&](const std::string &file, const decompress_options &options) {
+    CompressedReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    REQUIRE(csv.open(file, options));
+    REQUIRE(csv.cols() == 3);
+    size_t rows{0};
+    bool rows_match = true;
+    for (const auto row : csv) {
+      rows_match = rows_match && rows < expected.size() && row.as_string() == expected[rows];
+      ++rows;
+    }
+    REQUIRE(rows_match);
+    REQUIRE(rows == expected.size());
+    REQUIRE(csv.error() == 0);
+    return csv.source().frames();
+  };
+  const std::string file = "compressed_reader_test.csv.z";
+
+#ifdef CSV2_WITH_ZLIB
+  {
+    // concatenated members, decoded into chunks far smaller than a member
+    std::string compressed;
+    for (const auto part : parts)
+      compressed += gzip_member(part);
+    std::ofstream(file, std::ios::binary) << compressed;
+    decompress_options options;
+    options.chunk_size = 4096;
+    options.carry_capacity = 4096;
+    options.queue_depth = 3;
+    REQUIRE(read(file, options) == 0);
+  }
+#endif
+
+#ifdef CSV2_WITH_ZSTD
+  {
+    // independent frames with a skippable frame between them
+    std::string compressed;
+    for (const auto part : parts) {
+      std::string frame(ZSTD_compressBound(part.size()), '\0');
+      const auto size = ZSTD_compress(&frame[0], frame.size(), part.data(), part.size(), 3);
+      REQUIRE_FALSE(ZSTD_isError(size));
+      compressed.append(frame.data(), size);
+      if (compressed.size() == size)
+        compressed += std::string("\x50\x2A\x4D\x18\x04\x00\x00\x00skip", 12);
+    }
+    std::ofstream(file, std::ios::binary) << compressed;
+    decompress_options options;
+    options.carry_capacity = 4096;
+    options.threads = 3;
+    REQUIRE(read(file, options) == 3);
+    // the same frames through one sequential decoder and small chunks
+    options.threads = 1;
+    options.chunk_size = 4096;
+    REQUIRE(read(file, options) == 0);
+    // frames many chunks long are streamed rather than held whole per slot
+    options.threads = 3;
+    options.chunk_size = 64 * 1024;
+    REQUIRE(read(file, options) == 0);
+  }
+  {
+    // checksummed frames, an empty one among them, then the same frames
+    // without a declared content size
+    const auto frames = [&](bool content_size) {
+      std::string compressed;
+      ZSTD_CCtx *context = ZSTD_createCCtx();
+      ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+      ZSTD_CCtx_setParameter(context, ZSTD_c_contentSizeFlag, content_size ? 1 : 0);
+      for (const auto part : {parts[0], std::string_view(), parts[1], parts[2]}) {
+        std::string frame(ZSTD_compressBound(part.size()), '\0');
+        const auto size = ZSTD_compress2(context, &frame[0], frame.size(), part.data(), part.size());
+        REQUIRE_FALSE(ZSTD_isError(size));
+        compressed.append(frame.data(), size);
+      }
+      ZSTD_freeCCtx(context);
+      return compressed;
+    };
+    decompress_options options;
+    options.carry_capacity = 4096;
+    options.threads = 3;
+    std::ofstream(file, std::ios::binary) << frames(true);
+    REQUIRE(read(file, options) == 4);
+    std::ofstream(file, std::ios::binary) << frames(false);
+    REQUIRE(read(file, options) == 0);
+  }
+#endif
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Random access into compressed input through the index" * test_suite("SeekableReader")) {
+  std::vector<std::string> files{"inputs/test_12_unix.csv"};
+#ifdef CSV2_WITH_ZLIB
+  files.push_back("inputs/test_12_unix.csv.gz");
+#endif
+  for (const auto &file : files) {
+    SeekableReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    // a tiny span puts a checkpoint on every row of the plain file
+    REQUIRE(csv.open(file, 8));
+    REQUIRE(csv.size() == 2);
+    REQUIRE(csv.cols() == 3);
+    REQUIRE(csv.index().checkpoints().size() >= 1);
+
+    // backwards, so the second lookup has to decode from a checkpoint again
+    REQUIRE(csv[1].as_string() == "4,5,6");
+    REQUIRE(csv[0].as_string() == "1,2,3");
+    REQUIRE_THROWS_AS(csv[2], std::out_of_range);
+  }
+}
+
+#ifdef CSV2_WITH_ZLIB
+TEST_CASE("Resume decompression at checkpoints inside a gzip stream" * test_suite("SeekableReader")) {
+  std::string contents = "id,a,b\n";
+  uint32_t seed = 7;
+  for (size_t i = 0; i < 200000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    contents += std::to_string(i) + "," + std::to_string(seed % 100000) + "," + std::to_string(seed >> 8) + "\n";
+  }
+  // one big member, many deflate blocks, then a small stored one
+  const size_t split = contents.size() - 1000;
+  const std::string compressed = gzip_member(std::string_view(contents).substr(0, split)) +
+                                 gzip_member(std::string_view(contents).substr(split), 0);
+  REQUIRE(compressed.size() > 1024 * 1024);
+  const std::string file = "seekable_reader_test.csv.gz";
+  std::ofstream(file, std::ios::binary) << compressed;
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> plain;
+  REQUIRE(plain.parse(std::string_view(contents)));
+
+  CompressedIndex index;
+  REQUIRE(index.build(file, 64 * 1024));
+  REQUIRE(index.checkpoints().size() > 20);
+  // block boundaries inside the stream, with a window and bits to prime
+  REQUIRE(std::count_if(index.checkpoints().begin(), index.checkpoints().end(),
+                        [](const CompressedIndex::Checkpoint &c) { return !c.window.empty(); }) > 20);
+  REQUIRE(index.save(CompressedIndex::sidecar_path(file)));
+
+  {
+    SeekableReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    REQUIRE(csv.open(file, 64 * 1024)); // through the sidecar
+    REQUIRE(csv.index().checkpoints().size() == index.checkpoints().size());
+    REQUIRE(csv.size() == 200000);
+    bool rows_match = true;
+    for (size_t k = 0; k < 400; ++k) {
+      seed = seed * 1103515245 + 12345;
+      const size_t irow = k == 0 ? 199999 : seed % 200000;
+      rows_match = rows_match && csv[irow].as_string() == plain[irow].as_string();
+    }
+    REQUIRE(rows_match);
+  }
+
+  // touched: the sidecar no longer applies
+  const auto modified = std::filesystem::last_write_time(file);
+  std::filesystem::last_write_time(file, modified + std::chrono::seconds(1));
+  REQUIRE_FALSE(index.load(CompressedIndex::sidecar_path(file), file_stamp::of(file)));
+
+  // rewritten in place to the same size, with a different last row
+  std::string changed = contents;
+  changed.replace(contents.size() - 7, 6, "ZZZZZZ");
+  const std::string rewritten = gzip_member(std::string_view(changed).substr(0, split)) +
+                                gzip_member(std::string_view(changed).substr(split), 0);
+  REQUIRE(rewritten.size() == compressed.size());
+  std::ofstream(file, std::ios::binary | std::ios::in) << rewritten;
+  std::filesystem::last_write_time(file, modified);
+  {
+    SeekableReader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+    REQUIRE_FALSE(csv.open(file, index)); // built for the old contents
+    REQUIRE(csv.open(file, 64 * 1024));   // ignores the sidecar and indexes again
+    REQUIRE(csv[199999].as_string().substr(csv[199999].as_string().size() - 6) == "ZZZZZZ");
+  }
+  std::remove(CompressedIndex::sidecar_path(file).c_str());
+  std::remove(file.c_str());
+}
+#endif
+
+TEST_CASE("Write rows and read them back" * test_suite("Writer")) {
+  const std::string file = "writer_test.csv";
+  {
+    Writer<delimiter<','>, quote_character<'"'>> writer;
+    REQUIRE(writer.open(file, 16)); // rounded up, but still forces several flushes
+    REQUIRE(writer.write_row("a", "b", "c", "d"));
+    for (int i = 0; i < 1000; ++i)
+      REQUIRE(writer.write_row(i, 2.5, "x,y", "say \"hi\""));
+    REQUIRE(writer.write_fields(std::vector<std::string>{"1", "", "multi\nline", "end"}));
+    REQUIRE(writer.close());
+  }
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap(file));
+  REQUIRE(csv.cols() == 4);
+  REQUIRE(csv[0].as_string() == "0,2.5,\"x,y\",\"say \"\"hi\"\"\"");
+  REQUIRE(csv[999].as_string() == "999,2.5,\"x,y\",\"say \"\"hi\"\"\"");
+
+  const std::string last_row = "1,,\"multi\nline\",end\n";
+  std::ifstream stream(file, std::ios::binary);
+  const std::string contents((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+  REQUIRE(contents.substr(contents.size() - last_row.size()) == last_row);
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Write rows through a growing file mapping" * test_suite("Writer")) {
+  const std::string file = "mapped_writer_test.csv";
+  {
+    MappedWriter<delimiter<','>, quote_character<'"'>> writer;
+    REQUIRE(writer.open(file, 4096)); // one page per extent, so the mapping has to grow
+    REQUIRE(writer.write_row("a", "b", "c"));
+    for (int i = 0; i < 1000; ++i)
+      REQUIRE(writer.write_row(i, "x,y", -0.5));
+    REQUIRE(writer.close());
+  }
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap(file));
+  REQUIRE(csv.size() == 1000);
+  REQUIRE(csv[0].as_string() == "0,\"x,y\",-0.5");
+  REQUIRE(csv[999].as_string() == "999,\"x,y\",-0.5");
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Format batches on several threads and write them in order" * test_suite("Writer")) {
+  const std::string file = "parallel_writer_test.csv";
+  ParallelWriter<delimiter<','>, quote_character<'"'>> writer;
+  // nothing to queue into before open()
+  REQUIRE_FALSE(writer.submit([](auto &out) { out.write_row(0); }));
+  REQUIRE(writer.open(file, {4, 3}));
+  REQUIRE(writer.threads() == 4);
+  for (int batch = 0; batch < 100; ++batch) {
+    REQUIRE(writer.submit([batch](auto &out) {
+      for (int i = batch * 10; i < batch * 10 + 10; ++i)
+        out.write_row(i, "x,y");
+    }));
+  }
+  REQUIRE(writer.close());
+  REQUIRE_FALSE(writer.submit([](auto &out) { out.write_row(0); }));
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<false>> csv;
+  REQUIRE(csv.mmap(file));
+  REQUIRE(csv.rows() == 1000);
+  for (size_t i = 0; i < 1000; i += 99)
+    REQUIRE(csv[i].as_string() == std::to_string(i) + ",\"x,y\"");
+
+  // a failing batch stops the writer and its exception surfaces on close()
+  REQUIRE(writer.open(file, {2, 2}));
+  for (int batch = 0; batch < 10; ++batch) {
+    writer.submit([batch](auto &out) {
+      if (batch == 3)
+        throw std::runtime_error("bad batch");
+      out.write_row(batch);
+    });
+  }
+  REQUIRE_THROWS_AS(writer.close(), std::runtime_error);
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Copy rows through unchanged" * test_suite("Writer")) {
+  const std::string source = "passthrough_source.csv", file = "passthrough_test.csv";
+  {
+    Writer<delimiter<','>, quote_character<'"'>> writer;
+    REQUIRE(writer.open(source));
+    REQUIRE(writer.write_row("id", "name"));
+    // large enough for the kept runs to take the copy_file_range path
+    for (int i = 0; i < 20000; ++i)
+      REQUIRE(writer.write_row(i, "a \"quoted\", field"));
+  }
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.mmap(source));
+  {
+    Writer<delimiter<','>, quote_character<'"'>> writer;
+    REQUIRE(writer.open(file));
+    writer.copy_from(csv);
+    for (const auto &header : csv.header())
+      REQUIRE(writer.copy_row(header));
+    for (auto row : csv) {
+      const auto id = row.as_string().substr(0, row.as_string().find(','));
+      if (id != "5" && id != "19999")
+        REQUIRE(writer.copy_row(row));
+    }
+    REQUIRE(writer.write_row("end", "of file"));
+    REQUIRE(writer.close());
+  }
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> copy;
+  REQUIRE(copy.mmap(file));
+  REQUIRE(copy.size() == 19999);
+  REQUIRE(copy.header()[0].as_string() == "id,name");
+  REQUIRE(copy[4].as_string() == "4,\"a \"\"quoted\"\", field\"");
+  REQUIRE(copy[5].as_string() == "6,\"a \"\"quoted\"\", field\"");
+  REQUIRE(copy[19997].as_string() == "19998,\"a \"\"quoted\"\", field\"");
+  REQUIRE(copy[19998].as_string() == "end,of file");
+  std::remove(source.c_str());
+  std::remove(file.c_str());
+}
+
+TEST_CASE("Transcode between dialects" * test_suite("Transcoder")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view("a,b,c\n1,\"x,y\",\"say \"\"hi\"\"\"\n2,tab\there,\r\n3,4,5")));
+
+  // a one byte chunk size runs every line through the line-by-line path
+  for (size_t chunk_size : {size_t(1), size_t(1024)}) {
+    std::string tsv;
+    Writer<delimiter<'\t'>, quote_character<'"'>, memory_sink> writer;
+    REQUIRE(writer.open(tsv));
+    REQUIRE(transcode(csv, writer, chunk_size));
+    REQUIRE(writer.close());
+    // "x,y" no longer needs quotes, "tab\there" now does
+    REQUIRE(tsv == "a\tb\tc\n1\tx,y\t\"say \"\"hi\"\"\"\n2\t\"tab\there\"\t\r\n3\t4\t5\n");
+  }
+}
+
+TEST_CASE("Parse a numeric column into a contiguous buffer" * test_suite("Column")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view("id,price,name\n1, 2.5 ,a\n2,\"-3e2\",b\n3,,c\nx,n/a,d\n")));
+
+  std::vector<double> prices(csv.size());
+  REQUIRE(read_column(csv, 1, prices.data()) == 2);
+  REQUIRE(prices[0] == 2.5);
+  REQUIRE(prices[1] == -300.0);
+  REQUIRE(std::isnan(prices[2]));
+  REQUIRE(std::isnan(prices[3]));
+
+  std::vector<int64_t> ids(csv.size());
+  REQUIRE(read_column(csv, 0, ids.data()) == 1);
+  REQUIRE(ids == std::vector<int64_t>{1, 2, 3, 0});
+
+  // past the last column every cell is missing
+  REQUIRE(read_column(csv, 5, ids.data()) == 4);
+}
+
+TEST_CASE("Infer a schema and read several columns in one pass" * test_suite("Column")) {
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view("id,price,name,gap\n1,2.5,a,7\n2,3,\"b \"\"q\"\"\",\n3,4,c,9\n")));
+
+  const auto types = infer_schema(csv);
+  REQUIRE(types == std::vector<column_type>{column_type::integer, column_type::floating,
+                                            column_type::string, column_type::floating});
+  // a one-row sample only sees the first row
+  REQUIRE(infer_schema(csv, 1)[1] == column_type::floating);
+  REQUIRE(infer_schema(csv, 1)[3] == column_type::integer);
+
+  std::vector<int64_t> ids(csv.size());
+  std::vector<double> gaps(csv.size());
+  std::vector<std::string_view> names(csv.size()), prices(csv.size());
+  std::vector<column_output> columns{
+      {0, ids.data()}, {3, gaps.data()}, {2, names.data()}, {1, prices.data()}};
+  read_columns(csv, columns.data(), columns.size());
+  REQUIRE(ids == std::vector<int64_t>{1, 2, 3});
+  REQUIRE(gaps[0] == 7.0);
+  REQUIRE(std::isnan(gaps[1]));
+  REQUIRE(columns[1].missing == 1);
+  REQUIRE(names[1] == "b \"\"q\"\"");
+  REQUIRE(prices[2] == "4");
+
+  std::vector<int64_t> bad(csv.size());
+  column_output floats{1, bad.data()};
+  read_columns(csv, &floats, 1);
+  REQUIRE(floats.invalid == 1);
+  REQUIRE(bad == std::vector<int64_t>{0, 3, 4});
+}
+
+TEST_CASE("Sample column display widths per row prefix" * test_suite("Column")) {
+  std::string contents = "A:id,name\nB:key,value\n";
+  for (size_t i = 0; i < 100; ++i)
+    contents += i % 2 ? "A:" + std::to_string(i) + "," + std::string(i % 10, 'x') + "\n"
+                      : "B:" + std::to_string(i) + ",\xc3\xa9\n";
+  contents += "A:wide," + std::string(40, 'y') + "\n";
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  width_sample_options options;
+  options.head = 10;
+  options.tail = 1;
+  options.strided = 0;
+  options.percentile = 0.5;
+  const auto widths = column_widths(csv, options);
+  REQUIRE(widths.size() == 2);
+  const auto &a = widths.at("A");
+  REQUIRE(a.rows == 6);
+  REQUIRE(a.max == std::vector<size_t>{6, 40});
+  // 1, 3, 5, 7, 9 x's and the tail row
+  REQUIRE(a.percentile[1] == 5);
+  const auto &b = widths.at("B");
+  REQUIRE(b.rows == 5);
+  REQUIRE(b.max == std::vector<size_t>{3, 1}); // é is one column wide
+}
+
+TEST_CASE("Find substrings and regular expressions by row and cell" * test_suite("Search")) {
+  std::string contents = "id,name,note\n";
+  for (size_t i = 0; i < 100; ++i)
+    contents += std::to_string(i) + ",row" + std::to_string(i) + "," + (i % 30 == 7 ? "needle" : "hay") + "\n";
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  auto hit = find(csv, "needle");
+  REQUIRE(hit);
+  REQUIRE(hit->row == 7);
+  REQUIRE(hit->col == 2);
+  REQUIRE(std::string_view(csv.buffer() + hit->offset, hit->length) == "needle");
+  REQUIRE(find(csv, "needle", 8)->row == 37);
+  REQUIRE(find(csv, "needle", 98) == std::nullopt);
+  REQUIRE(find(csv, "needle", 36, search_direction::backward)->row == 7);
+  REQUIRE(find(csv, "needle", 1000, search_direction::backward)->row == 97);
+  REQUIRE(find(csv, "needle", 6, search_direction::backward) == std::nullopt);
+  // the header is not searched
+  REQUIRE(find(csv, "note") == std::nullopt);
+
+  hit = find_regex(csv, "^4[0-9],row");
+  REQUIRE(hit->row == 40);
+  REQUIRE(hit->col == 0);
+  REQUIRE(find_regex(csv, "w5[0-9]$") == std::nullopt);
+  REQUIRE(find_regex(csv, "row5[0-9]", 99, search_direction::backward)->row == 59);
+  REQUIRE_THROWS_AS(find_regex(csv, "("), std::regex_error);
+
+  // literals the regex prefilter looks for
+  REQUIRE(detail::required_literal("^4[0-9],row") == ",row");
+  REQUIRE(detail::required_literal("error: \\d+ files?") == "error: ");
+  REQUIRE(detail::required_literal("ab+c{2,3}x") == "ab");
+  REQUIRE(detail::required_literal("a\\.b(cdef)?") == "a.b");
+  REQUIRE(detail::required_literal("cat|dog").empty());
+
+  Searcher<decltype(csv)> searcher;
+  REQUIRE(searcher.start(csv, "needle"));
+  searcher.wait();
+  REQUIRE(searcher.progress() == 1.0);
+  const auto hits = searcher.hits();
+  REQUIRE(hits.size() == 4);
+  REQUIRE(hits[3].row == 97);
+  REQUIRE(searcher.next(8)->row == 37);
+  REQUIRE(searcher.next(36, search_direction::backward)->row == 7);
+  REQUIRE(searcher.next(98) == std::nullopt);
+
+  // ^ only matches at the start of a row, also after a match in the same row
+  REQUIRE(searcher.start(csv, "^[0-9]", true));
+  searcher.wait();
+  REQUIRE(searcher.hits_so_far() == 100);
+}
+
+TEST_CASE("Filter rows on the raw bytes of one column" * test_suite("Filter")) {
+  std::string contents = "id,city,price\n";
+  const char *cities[] = {"Paris", "\"Perth\"", "Berlin", " Porto "};
+  for (size_t i = 0; i < 100; ++i)
+    contents += std::to_string(i) + "," + cities[i % 4] + "," + (i % 10 ? std::to_string(i) + ".5" : "n/a") + "\n";
+
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  const auto perth = filter_rows(csv, 1, predicate::equals("Perth"));
+  REQUIRE(perth.size() == 25);
+  REQUIRE(perth[1] == 5);
+  REQUIRE(filter_rows(csv, 1, predicate::prefix("P")).size() == 75);
+  REQUIRE(filter_rows(csv, 1, predicate::in_set({"Berlin", "Porto"})).size() == 50);
+
+  // n/a cells are not numbers
+  const auto cheap = predicate::between(0, 20);
+  REQUIRE(filter_rows(csv, 2, cheap) == std::vector<size_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 14, 15, 16, 17, 18, 19});
+
+  const auto bitmap = filter_bitmap(csv, 1, predicate::equals("Berlin"));
+  REQUIRE(bitmap.size() == 2);
+  REQUIRE(bitmap[0] == 0x4444444444444444ull);
+  REQUIRE(bitmap[1] == 0x0000000444444444ull);
+
+  // copies keep working after the original is gone
+  auto copy = std::make_unique<predicate>(predicate::in_set({"Paris"}));
+  const predicate kept = *copy;
+  copy.reset();
+  REQUIRE(kept("Paris"));
+  REQUIRE_FALSE(kept("Par"));
+}
+
+TEST_CASE("Skip blocks with a zone map" * test_suite("Filter")) {
+  double seconds;
+  REQUIRE(parse_timestamp("1970-01-02", seconds));
+  REQUIRE(seconds == 86400);
+  REQUIRE(parse_timestamp("\"2020-02-29T12:30:15.25Z\"", seconds));
+  REQUIRE(seconds == 1582979415.25);
+  REQUIRE(parse_timestamp("20200229 12:30", seconds));
+  REQUIRE(seconds == 1582979400);
+  REQUIRE_FALSE(parse_timestamp("2020-02-29 12", seconds));
+  REQUIRE_FALSE(parse_timestamp("12.5", seconds));
+
+  // time-sorted ticks, a price that wraps around and a text column
+  std::string contents = "time,price,note\n";
+  for (size_t i = 0; i < 1000; ++i)
+    contents += "2020-01-01 00:" + std::string(i / 60 < 10 ? "0" : "") + std::to_string(i / 60) + ":" +
+                (i % 60 < 10 ? "0" : "") + std::to_string(i % 60) + "," +
+                (i % 97 == 5 ? std::string("") : std::to_string(i % 250)) + ",x" + std::to_string(i) + "\n";
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  ZoneMap zones;
+  REQUIRE(zones.build(csv, 100));
+  REQUIRE(zones.blocks() == 10);
+  REQUIRE(zones.kind(0) == ZoneMap::value_kind::timestamp);
+  REQUIRE(zones.kind(1) == ZoneMap::value_kind::number);
+  REQUIRE(zones.kind(2) == ZoneMap::value_kind::none);
+  REQUIRE(zones.zone(0, 1).missing == 1);
+  REQUIRE(zones.zone(9, 1).min == 150);
+  REQUIRE(zones.zone(9, 1).max == 249);
+
+  parse_timestamp("2020-01-01 00:05:00", seconds);
+  const auto minute = predicate::time_between(seconds, seconds + 59);
+  REQUIRE(zones.row_ranges(0, minute.low(), minute.high()) ==
+          std::vector<std::pair<size_t, size_t>>{{300, 400}});
+  REQUIRE(filter_rows(csv, 0, minute, zones) == filter_rows(csv, 0, minute));
+  REQUIRE(filter_rows(csv, 0, minute, zones).size() == 60);
+
+  for (const auto &test : {predicate::between(10, 20), predicate::between(0, 300), predicate::equals("7")})
+    REQUIRE(filter_bitmap(csv, 1, test, zones) == filter_bitmap(csv, 1, test));
+
+  const std::string path = "zone_map_test.csv2zone";
+  REQUIRE(zones.save(path));
+  ZoneMap loaded;
+  REQUIRE(loaded.load(path, file_stamp::of_reader(csv)));
+  REQUIRE(loaded.blocks() == 10);
+  REQUIRE(loaded.zone(3, 0).min == zones.zone(3, 0).min);
+  REQUIRE(filter_rows(csv, 0, minute, loaded).size() == 60);
+
+  // more zones than the rest of the file holds
+  const auto corrupt = patch_sidecar(path, 64, 1); // block_rows
+  REQUIRE_FALSE(loaded.load(corrupt, file_stamp::of_reader(csv)));
+  std::remove(corrupt.c_str());
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Skip blocks and files with Bloom filters" * test_suite("Filter")) {
+  // order ids are unique, accounts repeat
+  std::string contents = "order,account,qty\n";
+  for (size_t i = 0; i < 5000; ++i)
+    contents += "ORD" + std::to_string(100000 + i * 7) + ",\"acct" + std::to_string(i % 13) + "\"," +
+                std::to_string(i % 100) + "\n";
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  BloomFilter filter;
+  REQUIRE_FALSE(filter.build(csv, {3}));
+  REQUIRE(filter.build(csv, {1, 0}, 1000));
+  REQUIRE(filter.blocks() == 5);
+  REQUIRE(filter.columns() == std::vector<uint64_t>{0, 1});
+  REQUIRE_FALSE(filter.indexed(2));
+
+  // no false negatives, few false positives
+  bool all_found = true;
+  size_t false_positives = 0;
+  for (size_t i = 0; i < 5000; ++i) {
+    all_found = all_found && filter.may_contain(i / 1000, 0, "ORD" + std::to_string(100000 + i * 7));
+    false_positives += filter.may_contain(0, "ORD" + std::to_string(100001 + i * 7));
+  }
+  REQUIRE(all_found);
+  REQUIRE(false_positives < 100);
+  REQUIRE(filter.may_contain(1, "acct12"));
+  REQUIRE(filter.may_contain(2, "anything")); // no filter on that column
+
+  REQUIRE(filter.row_ranges(0, "ORD121000").size() <= 2);
+  const auto order = predicate::equals("ORD121000");
+  REQUIRE(filter_rows(csv, 0, order, filter) == std::vector<size_t>{3000});
+  const auto accounts = predicate::in_set({"acct3", "acct4"});
+  REQUIRE(filter_bitmap(csv, 1, accounts, filter) == filter_bitmap(csv, 1, accounts));
+  REQUIRE(filter_rows(csv, 2, predicate::equals("7"), filter).size() == 50);
+
+  const std::string path = "bloom_filter_test.csv2bloom";
+  REQUIRE(filter.save(path));
+  BloomFilter loaded;
+  REQUIRE(loaded.load(path, file_stamp::of_reader(csv)));
+  REQUIRE(loaded.may_contain(0, "ORD121000"));
+  REQUIRE(filter_rows(csv, 0, order, loaded) == std::vector<size_t>{3000});
+
+  // corrupt sizes whose product wraps around, or that would read past the
+  // end of the sidecar, must not load
+  const auto patched = [&](std::streamoff offset, uint64_t value) {
+    const auto corrupt = patch_sidecar(path, offset, value);
+    const bool accepted = BloomFilter().load(corrupt, file_stamp::of_reader(csv));
+    std::remove(corrupt.c_str());
+    return accepted;
+  };
+  REQUIRE(patched(64, 1000));                    // block_rows, unchanged
+  REQUIRE_FALSE(patched(72, uint64_t(1) << 61)); // block_bits
+  REQUIRE_FALSE(patched(80, uint64_t(1) << 58)); // file_bits
+  REQUIRE_FALSE(patched(64, 1));                 // block_rows: more blocks than words
+  REQUIRE_FALSE(patched(92, 3));                 // column count
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Look rows up by value through a hash index" * test_suite("Filter")) {
+  // unique order ids, repeated and quoted accounts
+  std::string contents = "order,account\n";
+  for (size_t i = 0; i < 20000; ++i)
+    contents += "X" + std::to_string(i * 31 % 20011) + ",\" acct" + std::to_string(i % 17) + "\"\n";
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  HashIndex orders;
+  REQUIRE_FALSE(orders.build(csv, 2));
+  REQUIRE(orders.build(csv, 0, 4));
+  REQUIRE(orders.rows() == 20000);
+  bool all_found = true;
+  for (size_t i = 0; i < 20000; i += 7)
+    all_found = all_found && orders.find_row(csv, "X" + std::to_string(i * 31 % 20011)) == i;
+  REQUIRE(all_found);
+  REQUIRE_FALSE(orders.find_row(csv, "X20011").has_value());
+  REQUIRE_FALSE(orders.find_row(csv, "X1 ").has_value());
+
+  HashIndex accounts;
+  REQUIRE(accounts.build(csv, 1));
+  const auto rows = accounts.find_rows(csv, " acct3");
+  REQUIRE(rows.size() == 1177);
+  REQUIRE(rows == filter_rows(csv, 1, predicate::equals(" acct3")));
+  REQUIRE(accounts.find_row(csv, " acct16") == 16);
+
+  const std::string path = HashIndex::sidecar_path("hash_index_test.csv", 0);
+  REQUIRE(orders.save(path));
+  HashIndex loaded;
+  REQUIRE(loaded.load(path, file_stamp::of_reader(csv)));
+  REQUIRE(loaded.col() == 0);
+  REQUIRE(loaded.find_row(csv, "X31") == 1);
+  REQUIRE(loaded.find_rows(csv, "X62") == std::vector<size_t>{2});
+  loaded = HashIndex();
+
+  // a corrupt slot count must not wrap the expected length around
+  const auto corrupt = patch_sidecar(path, 72, ~uint64_t(0)); // mask
+  REQUIRE_FALSE(loaded.load(corrupt, file_stamp::of_reader(csv)));
+  std::remove(corrupt.c_str());
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Reject the sidecars of a file rewritten in place" * test_suite("Filter")) {
+  // a middle row gets a new order id and quantity; the file keeps its size
+  // and its first and last 4 KiB, so only its modification time tells
+  std::string contents = "order,qty\n";
+  for (size_t i = 0; i < 5000; ++i)
+    contents += "ORD" + std::to_string(100000 + i) + "," + std::to_string(100 + i % 100) + "\n";
+  std::string changed = contents;
+  changed.replace(changed.find("ORD102500,100"), 13, "ORD999999,999");
+  using CSV = Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>>;
+
+  // Builds and saves a sidecar of the file, which loads and does not know
+  // the new row, then rewrites the file: the sidecar must no longer load
+  const std::string file = "sidecar_test.csv";
+  const auto check = [&](auto sidecar, const std::string &path, const auto &build, const auto &misses) {
+    std::ofstream(file, std::ios::binary) << contents;
+    CSV csv;
+    REQUIRE(csv.mmap(file));
+    REQUIRE(build(sidecar, csv));
+    REQUIRE(sidecar.save(path));
+    decltype(sidecar) loaded;
+    REQUIRE(loaded.load(path, file_stamp::of(file)));
+    REQUIRE(misses(loaded, csv));
+    auto stamp = file_stamp::of(file);
+    ++stamp.size;
+    REQUIRE_FALSE(loaded.load(path, stamp));
+
+    rewrite_in_place(file, changed);
+    CSV rewritten;
+    REQUIRE(rewritten.mmap(file));
+    REQUIRE(rewritten.size() == csv.size());
+    REQUIRE_FALSE(loaded.load(path, file_stamp::of_reader(rewritten)));
+    REQUIRE_FALSE(loaded.load(path, file_stamp::of(file)));
+    std::remove(path.c_str());
+    std::remove(file.c_str());
+  };
+  check(
+      ZoneMap(), ZoneMap::sidecar_path(file), [](ZoneMap &zones, const CSV &csv) { return zones.build(csv, 100); },
+      [](const ZoneMap &zones, const CSV &) { return zones.row_ranges(1, 900, 1000).empty(); });
+  check(
+      BloomFilter(), BloomFilter::sidecar_path(file),
+      [](BloomFilter &filter, const CSV &csv) { return filter.build(csv, {0}, 1000); },
+      [](const BloomFilter &filter, const CSV &) { return !filter.may_contain(0, "ORD999999"); });
+  check(
+      HashIndex(), HashIndex::sidecar_path(file, 0),
+      [](HashIndex &index, const CSV &csv) { return index.build(csv, 0); },
+      [](const HashIndex &index, const CSV &csv) { return !index.find_row(csv, "ORD999999"); });
+}
+
+TEST_CASE("Group rows and aggregate columns" * test_suite("Aggregate")) {
+  // desk and side keys, a quantity and a price with some gaps
+  std::string contents = "desk,side,qty,price\n";
+  const char *desks[] = {"rates", "\"fx\"", "credit"};
+  for (size_t i = 0; i < 10000; ++i)
+    contents += std::string(desks[i % 3]) + "," + (i % 2 ? "buy" : "sell") + "," + std::to_string(i % 10) +
+                "," + (i % 5 == 4 ? std::string("") : std::to_string(i % 7) + ".5") + "\n";
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  const std::vector<aggregate> aggregates = {{aggregate_op::count},
+                                             {aggregate_op::sum, 2},
+                                             {aggregate_op::min, 3},
+                                             {aggregate_op::max, 3},
+                                             {aggregate_op::mean, 3}};
+  // the same result with one thread and with several taking small chunks
+  for (const auto options : {group_by_options{1, 65536}, group_by_options{4, 100}}) {
+    const auto groups = group_by(csv, {0, 1}, aggregates, options);
+    REQUIRE(groups.size() == 6);
+    REQUIRE(groups[0].keys == std::vector<std::string_view>{"rates", "sell"});
+    REQUIRE(groups[1].keys == std::vector<std::string_view>{"fx", "buy"});
+    REQUIRE(groups[5].keys == std::vector<std::string_view>{"credit", "buy"});
+
+    // brute force the same figures
+    bool same = true;
+    for (size_t g = 0; g < 6; ++g) {
+      uint64_t rows = 0, priced = 0;
+      double qty = 0, low = 1e9, high = -1e9, total = 0;
+      for (size_t i = g; i < 10000; i += 6) {
+        ++rows;
+        qty += i % 10;
+        if (i % 5 != 4) {
+          ++priced;
+          low = std::min(low, i % 7 + 0.5);
+          high = std::max(high, i % 7 + 0.5);
+          total += i % 7 + 0.5;
+        }
+      }
+      const auto &values = groups[g].values;
+      same = same && groups[g].rows == rows && values[0] == rows && values[1] == qty &&
+             values[2] == low && values[3] == high && std::abs(values[4] - total / priced) < 1e-9;
+    }
+    REQUIRE(same);
+  }
+
+  // keys first seen only in later chunks, and again in chunks after those:
+  // groups come out in the order of their first row whichever thread saw it
+  std::string late = "key,n\n";
+  const auto key_of = [](size_t i) {
+    return i >= 730 && i % 11 == 0 ? "later" : i >= 420 && i % 37 == 0 ? "late" : "base";
+  };
+  for (size_t i = 0; i < 100000; ++i)
+    late += std::string(key_of(i)) + "," + std::to_string(i) + "\n";
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> late_csv;
+  REQUIRE(late_csv.parse(std::string_view(late)));
+  const std::vector<std::string_view> order = {"base", "late", "later"};
+  for (const auto options : {group_by_options{1, 65536}, group_by_options{4, 50}, group_by_options{8, 16}}) {
+    const auto groups = group_by(late_csv, {0}, {{aggregate_op::min, 1}, {aggregate_op::sum, 1}}, options);
+    REQUIRE(groups.size() == 3);
+    bool same = true;
+    for (size_t g = 0; g < 3; ++g) {
+      uint64_t rows = 0;
+      double first = -1, sum = 0;
+      for (size_t i = 0; i < 100000; ++i)
+        if (key_of(i) == order[g]) {
+          first = rows++ ? first : i;
+          sum += i;
+        }
+      same = same && groups[g].keys == std::vector<std::string_view>{order[g]} && groups[g].rows == rows &&
+             groups[g].values[0] == first && groups[g].values[1] == sum;
+    }
+    REQUIRE(same);
+  }
+
+  // no keys: one group for the file
+  const auto total = group_by(csv, {}, {{aggregate_op::sum, 2}}, {3, 1000});
+  REQUIRE(total.size() == 1);
+  REQUIRE(total[0].rows == 10000);
+  REQUIRE(total[0].values[0] == 45000);
+
+  // a column without numbers
+  const auto text = group_by(csv, {1}, {{aggregate_op::min, 0}, {aggregate_op::sum, 0}});
+  REQUIRE(std::isnan(text[0].values[0]));
+  REQUIRE(text[0].values[1] == 0);
+}
+
+TEST_CASE("Binary search a sorted key column" * test_suite("Sorted")) {
+  // every second has three ticks, prices rise by 0.5 per second, some
+  // prices are missing and the symbols are sorted as text
+  std::string contents = "time,price,symbol\n";
+  for (size_t i = 0; i < 3000; ++i) {
+    const auto second = i / 3;
+    contents += "2020-01-01T" + std::string(second / 3600 < 10 ? "0" : "") + std::to_string(second / 3600) +
+                ":" + (second / 60 % 60 < 10 ? "0" : "") + std::to_string(second / 60 % 60) + ":" +
+                (second % 60 < 10 ? "0" : "") + std::to_string(second % 60) + "," +
+                (i % 7 == 1 ? std::string("") : std::to_string(second / 2.0)) + ",S" +
+                std::to_string(1000 + i / 100) + "\n";
+  }
+  Reader<delimiter<','>, quote_character<'"'>, first_row_is_header<true>> csv;
+  REQUIRE(csv.parse(std::string_view(contents)));
+
+  const auto second = equal_range(csv, 0, "2020-01-01T00:05:00", key_order::timestamp);
+  REQUIRE(second == std::pair<size_t, size_t>{900, 903});
+  REQUIRE(lower_bound(csv, 0, "2020-01-01 00:05:00.5", key_order::timestamp) == 903);
+  REQUIRE(upper_bound(csv, 0, "2020-01-01 00:06", key_order::timestamp) == 1083);
+  REQUIRE(lower_bound(csv, 0, "1999-01-01", key_order::timestamp) == 0);
+  REQUIRE(lower_bound(csv, 0, "2099-01-01", key_order::timestamp) == csv.size());
+
+  // rows 1, 8, 15, ... have no price and are stepped over
+  REQUIRE(lower_bound(csv, 1, 10.5) == 63);
+  REQUIRE(equal_range(csv, 1, 0.0) == std::pair<size_t, size_t>{0, 3});
+  REQUIRE(lower_bound(csv, 1, 0.2) == 3);
+  for (double key = 0; key < 600; key += 7.25) {
+    const auto lower = lower_bound(csv, 1, key);
+    bool below = true;
+    for (size_t i = 0; i < lower; ++i) {
+      double value;
+      if (detail::parse_number(cell_view(csv[i], 1), value))
+        below = below && value < key;
+    }
+    REQUIRE(below);
+    const bool at_value =
+        lower == csv.size() || (lower % 7 != 1 && std::stod(std::string(cell_view(csv[lower], 1))) >= key);
+    REQUIRE(at_value);
+  }
+
+  REQUIRE(equal_range(csv, 2, "S1005") == std::pair<size_t, size_t>{500, 600});
+  REQUIRE(equal_range(csv, 2, "S10055") == std::pair<size_t, size_t>{600, 600});
+  REQUIRE_THROWS_AS(lower_bound(csv, 1, "cheap", key_order::number), std::invalid_argument);
+}
@@ -0,0 +1,92 @@
+#include <csv2/transcoder.hpp>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+using namespace csv2;
+
+// Usage: csv2-transcode [--from DIALECT] [--to DIALECT] <input> [<output>]
+// DIALECT is comma, tab, semicolon or pipe; output defaults to stdout.
+
+template <class In, class Out> int run(const char *input, const char *output) {
+  Reader<In, quote_character<'"'>, first_row_is_header<false>, trim_policy::no_trimming> csv;
+  if (!csv.mmap(input)) {
+    std::cerr << "error: Failed to open " << input << "\n";
+    return EXIT_FAILURE;
+  }
+
+  Writer<Out, quote_character<'"'>> writer;
+  const auto opened = output && strcmp(output, "-") != 0 ? writer.open(std::string(output))
+                                                         : writer.open(STDOUT_FILENO);
+  if (!opened) {
+    std::cerr << "error: Failed to open " << (output ? output : "stdout") << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (!transcode(csv, writer) || !writer.close()) {
+    std::cerr << "error: Failed to write " << (output ? output : "stdout") << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+template <class In> int run(char to, const char *input, const char *output) {
+  switch (to) {
+  case ',': return run<In, delimiter<','>>(input, output);
+  case '\t': return run<In, delimiter<'\t'>>(input, output);
+  case ';': return run<In, delimiter<';'>>(input, output);
+  default: return run<In, delimiter<'|'>>(input, output);
+  }
+}
+
+int run(char from, char to, const char *input, const char *output) {
+  switch (from) {
+  case ',': return run<delimiter<','>>(to, input, output);
+  case '\t': return run<delimiter<'\t'>>(to, input, output);
+  case ';': return run<delimiter<';'>>(to, input, output);
+  default: return run<delimiter<'|'>>(to, input, output);
+  }
+}
+
+char parse_dialect(const std::string &name) {
+  if (name == "comma" || name == ",")
+    return ',';
+  if (name == "tab" || name == "\\t")
+    return '\t';
+  if (name == "semicolon" || name == ";")
+    return ';';
+  if (name == "pipe" || name == "|")
+    return '|';
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char from = ',', to = '\t';
+  const char *input = nullptr, *output = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+      const auto dialect = parse_dialect(argv[++i]);
+      if (!dialect) {
+        std::cerr << "error: Unknown dialect " << argv[i] << "\n";
+        return EXIT_FAILURE;
+      }
+      (arg == "--from" ? from : to) = dialect;
+    } else if (!input) {
+      input = argv[i];
+    } else if (!output) {
+      output = argv[i];
+    } else {
+      input = nullptr;
+      break;
+    }
+  }
+
+  if (!input) {
+    std::cout << "Usage: ./csv2-transcode [--from comma|tab|semicolon|pipe] "
+                 "[--to comma|tab|semicolon|pipe] <input> [<output>]\n";
+    return EXIT_FAILURE;
+  }
+  return run(from, to, input, output);
+}
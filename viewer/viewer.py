@@ -1,4 +1,5 @@
 #!/usr/bin/env python3
+import bisect
 import os
 import sys
 import libpycsv2 as csv
@@ -7,6 +8,60 @@ import logging
 
 from wggridmultitles import GridMulTitles
 
+class PagedRows:
+    """Grid rows fetched from the reader a page at a time, so drawing a
+    screen costs one fetch() call instead of a call per cell"""
+    def __init__(self, csv_file, page_size=256):
+        self.csv_file = csv_file
+        self.page_size = page_size
+        self.page_start = 0
+        self.page = []
+
+    def __len__(self):
+        return len(self.csv_file)
+
+    def __getitem__(self, i):
+        if i < 0:
+            i += len(self)
+        if not 0 <= i < len(self):
+            raise IndexError(i)
+        if not self.page_start <= i < self.page_start + len(self.page):
+            self.page_start = i - i % self.page_size
+            self.page = self.csv_file.fetch(self.page_start, self.page_start + self.page_size)
+        return self.page[i - self.page_start]
+
+    def row_id(self, i):
+        return i
+
+    def position(self, row_id):
+        return row_id
+
+class FilteredRows:
+    """Grid rows restricted to the row ids returned by Reader.filter()"""
+    def __init__(self, csv_file, row_ids):
+        self.csv_file = csv_file
+        self.row_ids = row_ids
+        self.cached = (None, None)
+
+    def __len__(self):
+        return len(self.row_ids)
+
+    def __getitem__(self, i):
+        row_id = self.row_ids[i]
+        if self.cached[0] != row_id:
+            self.cached = (row_id, self.csv_file.fetch(row_id, row_id + 1)[0])
+        return self.cached[1]
+
+    def row_id(self, i):
+        return self.row_ids[i]
+
+    def position(self, row_id):
+        """Grid row showing file row `row_id`, None if it is filtered out"""
+        i = bisect.bisect_left(self.row_ids, row_id)
+        if i < len(self.row_ids) and self.row_ids[i] == row_id:
+            return i
+        return None
+
 class CSViewer(nps.Form):
     
     def collect_titles(self):
@@ -18,28 +73,31 @@ class CSViewer(nps.Form):
             self.titles.append(this_title)
         logging.info(f'headers:{self.titles}')
 
-    def cal_col_width(self, max_rows):
-        self.column_widths = [0]*len(self.titles[0])
+    def cal_col_width(self, sample_rows, percentile=0.95):
+        """Width of every column: its widest title, or the widest data cell
+        at `percentile` over head, tail and strided samples of each kind of
+        row (first cell prefix), computed by the reader"""
+        self.column_widths = [0]*self.csv_file.cols()
         for h in self.titles:
-            for i,c in enumerate(h):
+            for i,c in enumerate(h[:len(self.column_widths)]):
                 self.column_widths[i] = max(self.column_widths[i], len(c))
-        
-        considered = set()
-        for ir,r in enumerate(self.csv_file):
-            if ir >= max_rows or len(considered) == len(self.titles):
-                break
-            
-            for ic, c in enumerate(r):
-                if 0 == ic:
-                    considered.add(c.get_prefix(':'))
-                self.column_widths[i] = max(self.column_widths[ic], len(str(c)))
+
+        stats = self.csv_file.column_widths(head=sample_rows, tail=sample_rows,
+                                            strided=sample_rows, percentile=percentile)
+        for prefix, s in stats.items():
+            logging.info(f'prefix:{prefix!r} rows:{s["rows"]} max:{s["max"]}')
+            for i, w in enumerate(s['percentile']):
+                self.column_widths[i] = max(self.column_widths[i], w)
         return self.column_widths
 
     def create(self):
         self.workflow = 1
 
         self.csv_file = csv.CommaHeaderCSV()
-        self.csv_file.mmap(self.parentApp.get_csv_path())
+        # rows are indexed in the background, the grid grows as they arrive
+        self.csv_file.mmap_async(self.parentApp.get_csv_path())
+        # range filters skip blocks through a saved zone map, if there is one
+        self.csv_file.load_zone_map()
         self.collect_titles()
 
         self.screen_height, self.screen_width = self._max_physical()    
@@ -47,7 +105,7 @@ class CSViewer(nps.Form):
         border_height=1
         width = self.screen_width-4*border_width
         height = self.screen_height-2*border_height
-        column_widths=self.cal_col_width(50)
+        column_widths=self.cal_col_width(1000)
         column_width=0
         for col_width in column_widths:
             column_width = max(col_width, column_width)
@@ -66,8 +124,123 @@ class CSViewer(nps.Form):
                 , rely = border_height
                 , relx = border_width
                 # , select_whole_line=True
-                , values=self.csv_file
+                , values=PagedRows(self.csv_file)
+                , row_estimate=self.estimate_rows
                 )
+        self.search = None
+        self.csv_wg.handlers.update({
+            "/": self.h_search,
+            "f": self.h_search_next,
+            "F": self.h_search_prev,
+            "&": self.h_filter,
+        })
+
+    def estimate_rows(self):
+        """Rows indexed so far and, while indexing, the total they suggest"""
+        known = self.csv_file.rows_indexed_so_far()
+        progress = self.csv_file.indexing_progress()
+        if 0 < progress < 1:
+            return known, max(known, int(known / progress))
+        return known, known
+
+    def h_search(self, inpt):
+        """Ask for a pattern and start collecting its matches in the background"""
+        popup = nps.Popup(name='Search', lines=7)
+        pattern = popup.add(nps.TitleText, name='Pattern:')
+        regex = popup.add(nps.Checkbox, name='Regular expression')
+        popup.edit()
+        if not pattern.value:
+            return
+        if self.search is not None:
+            self.search.cancel()
+        try:
+            self.search = self.csv_file.search(pattern.value, regex=regex.value)
+        except ValueError as e:
+            nps.notify_confirm(str(e), title='Search')
+            self.search = None
+            return
+        self.search_step(0, False)
+
+    def h_search_next(self, inpt):
+        if self.search is not None:
+            self.search_step(self.csv_wg.edit_cell[0] + 1, False)
+
+    def h_search_prev(self, inpt):
+        if self.search is not None:
+            self.search_step(self.csv_wg.edit_cell[0] - 1, True)
+
+    def search_step(self, from_pos, backward):
+        """Move to the closest match found so far; the search keeps running,
+        so pressing the key again later may find more. Grid positions and the
+        searcher's file rows differ once a filter is shown: matches in rows
+        filtered out are skipped."""
+        if from_pos < 0:
+            return
+        view = self.csv_wg.values
+        try:
+            from_row = view.row_id(from_pos)
+        except IndexError:  # past the last filtered row
+            from_row = None
+        pos = hit = None
+        while from_row is not None and from_row >= 0:
+            hit = self.search.next(from_row, backward)
+            if hit is None:
+                break
+            pos = view.position(hit[0])
+            if pos is not None:
+                break
+            from_row = hit[0] - 1 if backward else hit[0] + 1
+        if pos is None:
+            state = 'no more matches' if self.search.done() else \
+                f'searching... {self.search.progress():.0%}'
+            nps.notify_wait(state, title='Search')
+            return
+        col = hit[1]
+        grid = self.csv_wg
+        grid.edit_cell = [pos, col]
+        grid.begin_col_display_at = (col // grid.columns) * grid.columns
+        grid.ensure_cursor_on_display_down_right()
+        grid.ensure_cursor_on_display_up()
+        grid.display()
+
+    FILTERS = ['equals', 'prefix', 'in set (a,b,...)', 'between (low,high)']
+
+    def h_filter(self, inpt):
+        """Show only the rows whose cell in a column matches; an empty value
+        shows every row again"""
+        popup = nps.Popup(name='Filter', lines=12)
+        column = popup.add(nps.TitleText, name='Column:', value=str(self.csv_wg.edit_cell[1]))
+        kind = popup.add(nps.TitleSelectOne, name='Match:', values=self.FILTERS, value=[0],
+                         max_height=len(self.FILTERS), scroll_exit=True)
+        value = popup.add(nps.TitleText, name='Value:')
+        popup.edit()
+
+        if not value.value:
+            self.csv_wg.values = PagedRows(self.csv_file)
+        else:
+            try:
+                col = int(column.value)
+                choice = kind.value[0] if kind.value else 0
+                if choice == 0:
+                    rows = self.csv_file.filter(col, equals=value.value)
+                elif choice == 1:
+                    rows = self.csv_file.filter(col, prefix=value.value)
+                elif choice == 2:
+                    rows = self.csv_file.filter(col, in_set=value.value.split(','))
+                else:
+                    low, high = value.value.split(',')
+                    try:
+                        bounds = (float(low), float(high))
+                    except ValueError:  # timestamps
+                        bounds = (low.strip(), high.strip())
+                    rows = self.csv_file.filter(col, between=bounds)
+            except (ValueError, IndexError) as e:
+                nps.notify_confirm(str(e), title='Filter')
+                return
+            self.csv_wg.values = FilteredRows(self.csv_file, rows)
+        self.csv_wg.edit_cell = [0, self.csv_wg.edit_cell[1]]
+        self.csv_wg.begin_row_display_at = 0
+        self.csv_wg.display()
 
     def resize(self):
         super(CSViewer, self).resize()
@@ -6,7 +6,9 @@ import logging
 
 class GridMulTitles(nps.SimpleGrid):
     _col_widgets = nps.Textfield
-    def __init__(self, screen, col_titles, *args, **keywords):
+    def __init__(self, screen, col_titles, *args, row_estimate=None, **keywords):
+        # row_estimate() -> (rows known, expected total) drives the scrollbar
+        self.row_estimate = row_estimate
         if col_titles:
             self.col_titles = col_titles
         else:
@@ -48,7 +50,9 @@ class GridMulTitles(nps.SimpleGrid):
 
         row, col = cell.grid_current_value_index
         if 0 == col and self.need_line_no:
-            cell.value = f'{row}: {value}'
+            # filtered views show the row's number in the file
+            row_id = getattr(self.values, 'row_id', None)
+            cell.value = f'{row_id(row) if row_id else row}: {value}'
         #logging.info(f'[{row},{col}] = {cell.value}')
     
     def highlight_or_not(self, r, c):
@@ -84,6 +88,33 @@ class GridMulTitles(nps.SimpleGrid):
                 _title_counter+=1
             
         self.parent.curses_pad.hline(self.rely+len(self.col_titles), self.relx, curses.ACS_HLINE, self.max_width+3*self.col_margin)
+        self.draw_scrollbar()
+
+    def draw_scrollbar(self):
+        """Scrollbar right of the grid. While rows are still being indexed the
+        total is an estimate and the part not indexed yet is dotted."""
+        if self.row_estimate is None:
+            return
+        known, total = self.row_estimate()
+        top = self.rely + self.additional_y_offset
+        height = self.height - self.additional_y_offset
+        if height <= 0 or total <= 0:
+            return
+
+        x = self.relx + self.width
+        known_end = height * known // total
+        thumb = min(height - 1, height * self.begin_row_display_at // total)
+        for y in range(height):
+            if y == thumb:
+                ch = curses.ACS_CKBOARD
+            elif y < known_end or known == total:
+                ch = curses.ACS_VLINE
+            else:
+                ch = ord(':')
+            try:
+                self.parent.curses_pad.addch(top + y, x, ch)
+            except curses.error:
+                return
     
     def update_title_cell(self, cell, cell_title):
         cell.value = cell_title